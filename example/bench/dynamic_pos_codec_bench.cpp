@@ -0,0 +1,92 @@
+#include <ot/dynamic_pos_codec.h>
+
+#include <chrono>
+#include <cstdio>
+
+/**
+    Encode/decode throughput and snapshot size of dynamic_pos_codec for a
+    stream of snapshots of moving objects, compared to raw dynamic_pos
+    arrays. Every 4th object sleeps, the rest move at 1..20 m/s.
+
+    Usage: dynamic_pos_codec_bench [objects] [snapshots]
+**/
+
+using clk = std::chrono::high_resolution_clock;
+
+int main( int argc, char* argv[] )
+{
+    uint count = argc > 1 ? uint(atoi(argv[1])) : 10000;
+    uint frames = argc > 2 ? uint(atoi(argv[2])) : 300;
+    const float dt = 1.0f / 30;
+
+    coid::dynarray<ot::dynamic_pos> src;
+    coid::dynarray<uint> ids;
+    src.resize(count);
+    ids.resize(count);
+
+    //objects scattered over a 20km area
+    const double3 center = double3(0, 0, ot::rad_eq);
+    for (uint i = 0; i < count; ++i) {
+        ot::dynamic_pos& d = src[i];
+        d.pos = center + double3((i * 7919 % 20000) - 10000.0, (i * 104729 % 20000) - 10000.0, (i % 50) * 0.5);
+        d.rot = glm::normalize(quat(1.0f, 0.01f * (i % 13), 0.02f * (i % 7), 0.0f));
+        d.vel = (i & 3) ? float3(1.0f + i % 20, 0.5f * (i % 5), 0) : float3(0);
+        d.ang = (i & 3) ? float3(0, 0, 0.1f) : float3(0);
+        ids[i] = i;
+    }
+
+    ot::dynamic_pos_codec enc, dec;
+    coid::dynarray<uint8> buf;
+    coid::dynarray<uint> ids_out;
+    coid::dynarray<ot::dynamic_pos> dst;
+
+    double enc_ns = 0, dec_ns = 0;
+    uints bytes = 0, key_bytes = 0;
+    double max_pos_err = 0;
+
+    for (uint f = 0; f < frames; ++f)
+    {
+        for (uint i = 0; i < count; ++i) {
+            ot::dynamic_pos s = src[i];
+            s.predict_position(dt, src[i]);
+        }
+
+        buf.reset();
+        auto t0 = clk::now();
+        uints size = enc.encode(ids.ptr(), src.ptr(), count, f == 0, buf);
+        auto t1 = clk::now();
+        uints used = dec.decode(buf.ptr(), buf.size(), ids_out, dst);
+        auto t2 = clk::now();
+
+        if (!size || used != size) {
+            printf("snapshot %u failed to round-trip\n", f);
+            return 1;
+        }
+
+        enc_ns += std::chrono::duration<double, std::nano>(t1 - t0).count();
+        dec_ns += std::chrono::duration<double, std::nano>(t2 - t1).count();
+        if (f == 0)
+            key_bytes = size;
+        else
+            bytes += size;
+
+        for (uint i = 0; i < count; ++i) {
+            double3 e = glm::abs(dst[i].pos - src[i].pos);
+            max_pos_err = glm::max(max_pos_err, glm::max(e.x, glm::max(e.y, e.z)));
+        }
+    }
+
+    double raw = double(count) * (sizeof(ot::dynamic_pos) + sizeof(uint));
+    double delta = frames > 1 ? double(bytes) / (frames - 1) : 0;
+
+    printf("objects %u, snapshots %u\n", count, frames);
+    printf("raw        %10.0f B/snapshot\n", raw);
+    printf("keyframe   %10llu B/snapshot  %5.2f B/object  ratio %.1fx\n",
+        (unsigned long long)key_bytes, double(key_bytes) / count, raw / key_bytes);
+    printf("delta      %10.0f B/snapshot  %5.2f B/object  ratio %.1fx\n",
+        delta, delta / count, delta > 0 ? raw / delta : 0.0);
+    printf("encode     %10.1f ns/object\n", enc_ns / frames / count);
+    printf("decode     %10.1f ns/object\n", dec_ns / frames / count);
+    printf("max position error %.6f m per axis (bound %.6f m)\n", max_pos_err, enc.max_pos_error());
+    return 0;
+}
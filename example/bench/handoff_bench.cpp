@@ -0,0 +1,223 @@
+#include <ot/handoff.h>
+#include <comm/dynarray.h>
+#include <comm/sync/mutex.h>
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <mutex>
+
+/**
+    Throughput of the handoff primitives against the share_lock() pattern
+    of the generated interfaces (a static coid::comm_mutex guarding shared
+    state):
+        - spsc:   one producer, one consumer, spsc_ring vs a mutex-guarded
+                  queue swapped out by the consumer
+        - mpsc:   several producers, one consumer, mpsc_ring vs the same
+                  mutex-guarded queue
+        - latest: one writer publishing a state, one reader polling it,
+                  triple_buffer vs copying the state under the mutex
+
+    Idle sides yield, so the numbers stay meaningful on machines with fewer
+    cores than threads, but the intended setup is one core per thread.
+
+    Usage: handoff_bench [messages] [producers]
+**/
+
+using clk = std::chrono::high_resolution_clock;
+
+struct message
+{
+    uint64 seq;
+    float data[6];
+};
+
+struct state
+{
+    uint64 seq;
+    float data[30];
+};
+
+///The share_lock() pattern of the generated interfaces
+static coid::comm_mutex& share_lock() {
+    static coid::comm_mutex _mx(500, false);
+    return _mx;
+}
+
+static double seconds_since( clk::time_point t0 ) {
+    return std::chrono::duration<double>(clk::now() - t0).count();
+}
+
+static ot::spsc_ring<message, 1024> _spsc;
+static ot::mpsc_ring<message, 1024> _mpsc;
+static ot::triple_buffer<state> _triple;
+
+static coid::dynarray<message> _locked_queue;
+static state _locked_state;
+
+///Single consumer of the mutex-guarded queue
+//@return sum of the sequence numbers
+static uint64 consume_locked( uint64 total )
+{
+    coid::dynarray<message> local;
+    uint64 n = 0, sum = 0;
+    while (n < total) {
+        {
+            std::lock_guard<coid::comm_mutex> lock(share_lock());
+            local.swap(_locked_queue);
+        }
+        if (!local.size()) {
+            std::this_thread::yield();
+            continue;
+        }
+        for (uint i = 0; i < local.size(); ++i)
+            sum += local[i].seq;
+        n += local.size();
+        local.reset();
+    }
+    return sum;
+}
+
+static void produce_locked( uint64 first, uint64 count )
+{
+    for (uint64 i = first; i < first + count; ++i) {
+        message m;
+        m.seq = i;
+        std::lock_guard<coid::comm_mutex> lock(share_lock());
+        *_locked_queue.add() = m;
+    }
+}
+
+template <class Ring>
+static void produce_ring( Ring& r, uint64 first, uint64 count )
+{
+    for (uint64 i = first; i < first + count; ++i) {
+        message m;
+        m.seq = i;
+        while (!r.push(m))
+            std::this_thread::yield();
+    }
+}
+
+template <class Ring>
+static uint64 consume_ring( Ring& r, uint64 total )
+{
+    uint64 n = 0, sum = 0;
+    message m;
+    while (n < total) {
+        if (r.pop(m)) {
+            sum += m.seq;
+            ++n;
+        }
+        else
+            std::this_thread::yield();
+    }
+    return sum;
+}
+
+static void report( const char* name, double lockfree, double locked, uint64 n )
+{
+    printf("%-8s lock-free %7.1f ns/msg   share_lock %7.1f ns/msg   %5.1fx\n",
+        name, lockfree * 1e9 / n, locked * 1e9 / n, locked / lockfree);
+}
+
+int main( int argc, char* argv[] )
+{
+    const uint64 count = argc > 1 ? uint64(atoll(argv[1])) : 4000000;
+    const uint nprod = argc > 2 ? uint(atoi(argv[2])) : 3;
+    const uint64 expected = count * (count - 1) / 2;
+    const uint64 per = count / nprod;
+    const uint64 mcount = per * nprod;
+    const uint64 mexpected = mcount * (mcount - 1) / 2;
+
+    //spsc
+    clk::time_point t0 = clk::now();
+    std::thread p1([&]() { produce_ring(_spsc, 0, count); });
+    uint64 s1 = consume_ring(_spsc, count);
+    p1.join();
+    double spsc_t = seconds_since(t0);
+
+    t0 = clk::now();
+    std::thread p2([&]() { produce_locked(0, count); });
+    uint64 s2 = consume_locked(count);
+    p2.join();
+    double spsc_lt = seconds_since(t0);
+
+    //mpsc
+    std::thread* prod = new std::thread[nprod];
+
+    t0 = clk::now();
+    for (uint p = 0; p < nprod; ++p)
+        prod[p] = std::thread([&, p]() { produce_ring(_mpsc, p * per, per); });
+    uint64 s3 = consume_ring(_mpsc, mcount);
+    for (uint p = 0; p < nprod; ++p)
+        prod[p].join();
+    double mpsc_t = seconds_since(t0);
+
+    t0 = clk::now();
+    for (uint p = 0; p < nprod; ++p)
+        prod[p] = std::thread([&, p]() { produce_locked(p * per, per); });
+    uint64 s4 = consume_locked(mcount);
+    for (uint p = 0; p < nprod; ++p)
+        prod[p].join();
+    double mpsc_lt = seconds_since(t0);
+
+    delete[] prod;
+
+    //latest value, the reader polls until it sees the last published state
+    t0 = clk::now();
+    std::thread w1([&]() {
+        for (uint64 i = 1; i <= count; ++i) {
+            _triple.back().seq = i;
+            _triple.publish();
+        }
+    });
+    uint64 reads = 0;
+    for (;;) {
+        if (_triple.update())
+            ++reads;
+        else
+            std::this_thread::yield();
+        if (_triple.front().seq == count)
+            break;
+    }
+    w1.join();
+    double tb_t = seconds_since(t0);
+
+    t0 = clk::now();
+    std::thread w2([&]() {
+        state s = {};
+        for (uint64 i = 1; i <= count; ++i) {
+            s.seq = i;
+            std::lock_guard<coid::comm_mutex> lock(share_lock());
+            _locked_state = s;
+        }
+    });
+    uint64 lreads = 0;
+    for (;;) {
+        state s;
+        {
+            std::lock_guard<coid::comm_mutex> lock(share_lock());
+            s = _locked_state;
+        }
+        ++lreads;
+        if (s.seq == count)
+            break;
+        std::this_thread::yield();
+    }
+    w2.join();
+    double tb_lt = seconds_since(t0);
+
+    if (s1 != expected || s2 != expected || s3 != mexpected || s4 != mexpected) {
+        printf("message loss detected\n");
+        return 1;
+    }
+
+    printf("%llu messages, %u producers for mpsc\n", (unsigned long long)count, nprod);
+    report("spsc", spsc_t, spsc_lt, count);
+    report("mpsc", mpsc_t, mpsc_lt, mcount);
+    report("latest", tb_t, tb_lt, count);
+    printf("latest   reader got %llu new values (triple_buffer), polled %llu times (share_lock)\n",
+        (unsigned long long)reads, (unsigned long long)lreads);
+    return 0;
+}
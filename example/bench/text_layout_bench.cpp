@@ -0,0 +1,106 @@
+#include <ot/text_layout.h>
+#include <comm/str.h>
+
+#include <chrono>
+#include <cstdio>
+
+/**
+    Per-frame cost of laying out canvas labels: full relayout of every label
+    against text_label (incremental re-measure of the changed digits) and
+    text_layout_cache (immediate-mode labels, mostly static text). Half of
+    the labels are numeric readouts changing every frame, the rest are
+    static two-line captions. Commands are recorded, not submitted.
+
+    Usage: text_layout_bench [labels] [frames]
+**/
+
+using clk = std::chrono::high_resolution_clock;
+
+static double ns_since( clk::time_point t0 ) {
+    return std::chrono::duration<double, std::nano>(clk::now() - t0).count();
+}
+
+int main( int argc, char* argv[] )
+{
+    uint count = argc > 1 ? uint(atoi(argv[1])) : 200;
+    uint frames = argc > 2 ? uint(atoi(argv[2])) : 1000;
+
+    //synthetic BMFont descriptor with varying advances
+    coid::charstr fnt = "common lineHeight=18 base=14\n";
+    for (uint c = 32; c < 127; ++c)
+        fnt << "char id=" << c << " xadvance=" << (6 + c % 5) << "\n";
+
+    ot::font_metrics fm;
+    if (!fm.parse(fnt)) {
+        printf("failed to parse font\n");
+        return 1;
+    }
+
+    const uint font = 1;
+    coid::dynarray<ot::text_box> boxes;
+    coid::dynarray<ot::text_label*> labels;
+    boxes.resize(count);
+    for (uint i = 0; i < count; ++i) {
+        boxes[i] = ot::text_box(float(i % 10) * 100, float(i / 10) * 40, 90, 36,
+            (i & 1) ? ot::ANCHOR_RIGHT | ot::ANCHOR_VCENTER : ot::ANCHOR_HCENTER | ot::ANCHOR_TOP);
+        *labels.add() = new ot::text_label(font, &fm, boxes[i]);
+    }
+
+    ot::text_layout_cache cache;
+    cache.set_font(font, &fm);
+
+    ot::canvas_cmdbuf cb;
+    coid::dynarray<ot::text_line> lines;
+    coid::charstr text;
+
+    auto make_text = [&text](uint i, uint f) -> coid::token {
+        text.reset();
+        if (i & 1)
+            text << "ALT " << (1000 + (f * 37 + i * 11) % 9000) << " ft";
+        else
+            text << "WAYPOINT " << i << "\nDIST 12.4 nm";
+        return text;
+    };
+
+    double full_ns = 0, label_ns = 0, cache_ns = 0;
+
+    for (uint f = 0; f < frames; ++f)
+    {
+        cb.reset();
+        clk::time_point t0 = clk::now();
+        for (uint i = 0; i < count; ++i) {
+            coid::token t = make_text(i, f);
+            ot::text_layout_lines(fm, boxes[i], true, t.ptr(), uint(t.len()), lines);
+            ot::text_emit_lines(cb, font, t.ptr(), lines.ptr(), uint(lines.size()), u8vec4(0xff));
+        }
+        full_ns += ns_since(t0);
+
+        cb.reset();
+        t0 = clk::now();
+        for (uint i = 0; i < count; ++i) {
+            labels[i]->set_text(make_text(i, f));
+            labels[i]->emit(cb, u8vec4(0xff));
+        }
+        label_ns += ns_since(t0);
+
+        cb.reset();
+        t0 = clk::now();
+        for (uint i = 0; i < count; ++i)
+            cache.draw(cb, font, boxes[i], make_text(i, f), u8vec4(0xff));
+        cache.frame();
+        cache_ns += ns_since(t0);
+    }
+
+    uint relayouts = 0;
+    for (uint i = 0; i < count; ++i) {
+        relayouts += labels[i]->relayouts();
+        delete labels[i];
+    }
+
+    double n = double(frames) * count;
+    printf("labels %u, frames %u, %u commands/frame\n", count, frames, cb.size());
+    printf("full relayout  %8.1f ns/label\n", full_ns / n);
+    printf("text_label     %8.1f ns/label  %u full relayouts\n", label_ns / n, relayouts);
+    printf("layout cache   %8.1f ns/label  %u hits, %u misses\n", cache_ns / n, cache.hits(), cache.misses());
+    return 0;
+}
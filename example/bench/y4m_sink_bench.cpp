@@ -0,0 +1,120 @@
+#include <ot/y4m_sink.h>
+
+#include <chrono>
+#include <cstdio>
+
+/**
+    Sustained write throughput of y4m_sink at 4K60: synthetic I420 frames
+    stamped 1/60 s apart are written straight to the sink, the time of each
+    write is compared with the 16.7 ms frame budget. The output goes into
+    the given folder, use a folder on the capture drive.
+
+    The writes only dirty the page cache. The timed close also flushes the
+    written chunk files to the disk, so the reported throughput is the
+    sustained disk rate, not the page cache rate.
+
+    Usage: y4m_sink_bench [folder] [frames] [width] [height] [chunk MB]
+**/
+
+using clk = std::chrono::high_resolution_clock;
+
+///Flush the dirty pages of a closed output file to the disk
+static bool flush_file( const char* path )
+{
+#ifdef _WIN32
+    HANDLE h = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, OPEN_EXISTING, 0, 0);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+    bool ok = FlushFileBuffers(h) != 0;
+    CloseHandle(h);
+#else
+    int fd = ::open(path, O_RDWR);
+    if (fd < 0)
+        return false;
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+#endif
+    return ok;
+}
+
+int main( int argc, char* argv[] )
+{
+    const char* folder = argc > 1 ? argv[1] : ".";
+    uint frames = argc > 2 ? uint(atoi(argv[2])) : 600;
+    uint width = argc > 3 ? uint(atoi(argv[3])) : 3840;
+    uint height = argc > 4 ? uint(atoi(argv[4])) : 2160;
+    uint64 chunk = argc > 5 ? uint64(atoi(argv[5])) << 20 : uint64(16) << 30;
+    const uint fps = 60;
+
+    const uint cw = width / 2, ch = (height + 1) / 2;
+    coid::dynarray<uint8> y, u, v;
+    y.resize(uints(width) * height);
+    u.resize(uints(cw) * ch);
+    v.resize(uints(cw) * ch);
+
+    ot::y4m_sink sink(fps, chunk);
+    if (!sink.open(folder, width, height)) {
+        printf("failed to open the output in %s\n", folder);
+        return 1;
+    }
+
+    ot::i420_frame f;
+    f.y = y.ptr();
+    f.u = u.ptr();
+    f.v = v.ptr();
+    f.width = width;
+    f.height = height;
+    f.cwidth = cw;
+    f.cheight = ch;
+    f.ystride = width;
+    f.cstride = cw;
+    f.nbatchframes = 1;
+
+    const double budget_ms = 1000.0 / fps;
+    double total_ms = 0, max_ms = 0;
+    uint over = 0;
+
+    for (uint i = 0; i < frames; ++i)
+    {
+        //moving gradient so that the pages are actually touched
+        ::memset(y.ptr() + (uints(i) * width) % y.size(), int(i), width);
+        f.timestamp_ns = uint64(i) * 1000000000 / fps;
+
+        auto t0 = clk::now();
+        sink.write(f);
+        double ms = std::chrono::duration<double, std::milli>(clk::now() - t0).count();
+
+        total_ms += ms;
+        if (ms > max_ms)
+            max_ms = ms;
+        if (ms > budget_ms)
+            ++over;
+    }
+
+    auto t0 = clk::now();
+    sink.close();
+
+    const ot::y4m_sink::stats& st = sink.get_stats();
+    uint unflushed = 0;
+    for (uint k = 0; k < st.chunks; ++k) {
+        coid::charstr path = folder;
+        path << "/capture_" << width << 'x' << height;
+        if (k)
+            path << '_' << k;
+        path << ".y4m";
+        unflushed += !flush_file(path.c_str());
+    }
+    double close_ms = std::chrono::duration<double, std::milli>(clk::now() - t0).count();
+
+    double mb = double(st.bytes) / (1 << 20);
+
+    printf("%ux%u @%u fps, %u frames, %u chunks\n", width, height, fps, frames, st.chunks);
+    printf("write      %8.2f ms/frame avg  %8.2f ms max  (budget %.2f ms, %u over)\n",
+        total_ms / frames, max_ms, budget_ms, over);
+    printf("throughput %8.0f MB/s  (4K60 needs %.0f MB/s)\n",
+        mb / ((total_ms + close_ms) / 1000), double(width) * height * 1.5 * fps / (1 << 20));
+    printf("close      %8.2f ms  (including the flush to disk)\n", close_ms);
+    if (unflushed)
+        printf("%u chunk files could not be flushed, the throughput includes unflushed data\n", unflushed);
+    return 0;
+}
@@ -0,0 +1,546 @@
+#pragma once
+#ifndef __OT_ANIM_CODEC_H__
+#define __OT_ANIM_CODEC_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+
+#include <cfloat>
+#include <chrono>
+
+#include "anim_sampler.h"
+#include "glm/glm_ext.h"
+
+/**
+    Compressed animation clips.
+
+    anim_codec::encode compresses a baked anim_clip into one contiguous blob
+    that can be written to disk and memory-mapped back as is:
+        - every bone has a rotation and a translation track
+        - tracks that stay within the error budget of their first frame are
+          stored as a single constant key
+        - other tracks are reduced by greedy curve fitting: a key is kept
+          only where linear interpolation between the kept keys would exceed
+          the error budget
+        - rotations are quantized to 48 bits (smallest three: index of the
+          largest component and three 15 bit components), translations to
+          16 bits per component within the track's range
+
+    The error of the fit is measured on the quantized keys, so the decoded
+    clip stays within the budget of the source.
+
+    compressed_clip is a non-owning view of a blob, sampling it at any time
+    into an anim_pose. Key lookup is a binary search per track, or O(1) for
+    sequential playback with a clip_cursor.
+
+    Example:
+        coid::dynarray<uint8> blob;
+        ot::anim_codec::stats st;
+        ot::anim_codec::encode(clip, ot::anim_codec::params(), blob, &st);
+        //st.ratio
+
+        ot::compressed_clip cc;
+        cc.bind(blob.ptr(), blob.size());   //or a mapped file
+        cc.sample(t, true, pose, &cursor);
+**/
+
+namespace ot {
+
+////////////////////////////////////////////////////////////////////////////////
+///Blob layout
+struct anim_blob
+{
+    enum : uint {
+        MAGIC = 0x31636361,             //< "acc1" in file byte order (little endian)
+        VERSION = 1,
+    };
+
+    struct header
+    {
+        uint magic;
+        uint version;
+        uint size;                      //< total blob size [B]
+        uint nbones;
+        uint nframes;
+        float fps;
+    };
+
+    ///Track descriptor, header is followed by nbones rotation and nbones translation tracks
+    struct track
+    {
+        uint offset;                    //< byte offset of key frames (uint16[nkeys]) followed by values (uint16[3*nkeys])
+        uint nkeys;                     //< 1 for constant tracks
+        float min[3];                   //< translation range
+        float scale[3];
+    };
+
+    //@{ smallest three 48 bit quaternion
+    static void pack_quat( quat q, uint16* dst )
+    {
+        float c[4] = { q.x, q.y, q.z, q.w };
+        uint big = 0;
+        for (uint i = 1; i < 4; ++i)
+            if (fabsf(c[i]) > fabsf(c[big]))
+                big = i;
+
+        float s = c[big] < 0 ? -1.0f : 1.0f;
+        uint64 bits = uint64(big) << 45;
+        uint shift = 30;
+
+        for (uint i = 0; i < 4; ++i) {
+            if (i == big)
+                continue;
+            float v = glm::clamp(c[i] * s * 0.70710678f + 0.5f, 0.0f, 1.0f);
+            bits |= uint64(v * 32767.0f + 0.5f) << shift;
+            shift -= 15;
+        }
+
+        dst[0] = uint16(bits);
+        dst[1] = uint16(bits >> 16);
+        dst[2] = uint16(bits >> 32);
+    }
+
+    static quat unpack_quat( const uint16* src )
+    {
+        uint64 bits = uint64(src[0]) | (uint64(src[1]) << 16) | (uint64(src[2]) << 32);
+        uint big = uint(bits >> 45) & 3;
+
+        float c[4];
+        float sum = 0;
+        uint shift = 30;
+
+        for (uint i = 0; i < 4; ++i) {
+            if (i == big)
+                continue;
+            float v = float((bits >> shift) & 0x7fff) * (1.0f / 32767.0f);
+            c[i] = (v - 0.5f) * 1.41421356f;
+            sum += c[i] * c[i];
+            shift -= 15;
+        }
+
+        c[big] = sqrtf(glm::max(0.0f, 1.0f - sum));
+        return quat(c[3], c[0], c[1], c[2]);
+    }
+    //@}
+};
+
+///Per-track key positions for sequential playback
+struct clip_cursor
+{
+    coid::dynarray<uint16> key;         //< last key index per track
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///Non-owning view of a compressed clip blob
+class compressed_clip
+{
+public:
+
+    ///Bind to blob memory, which must stay valid while used
+    //@return false if the blob is not valid, including any track outside of the blob
+    bool bind( const void* data, uints size )
+    {
+        const anim_blob::header* h = (const anim_blob::header*)data;
+        if (size < sizeof(anim_blob::header)
+            || h->magic != anim_blob::MAGIC || h->version != anim_blob::VERSION || h->size > size
+            || sizeof(anim_blob::header) + 2 * uints(h->nbones) * sizeof(anim_blob::track) > h->size)
+            return false;
+
+        //every track needs at least one key and its keys within the blob
+        const anim_blob::track* tracks = (const anim_blob::track*)(h + 1);
+        for (uint i = 0, n = 2 * h->nbones; i < n; ++i) {
+            const anim_blob::track& tr = tracks[i];
+            if (tr.nkeys == 0 || tr.nkeys > h->nframes || (tr.offset & 1)
+                || uints(tr.offset) + 4 * uints(tr.nkeys) * sizeof(uint16) > h->size)
+                return false;
+        }
+
+        _base = (const uint8*)data;
+        _hdr = h;
+        _tracks = tracks;
+        return true;
+    }
+
+    uint bone_count() const { return _hdr ? _hdr->nbones : 0; }
+    uint frame_count() const { return _hdr ? _hdr->nframes : 0; }
+    float fps() const { return _hdr ? _hdr->fps : 0; }
+    uint byte_size() const { return _hdr ? _hdr->size : 0; }
+
+    float duration() const {
+        return _hdr && _hdr->nframes > 1 ? (_hdr->nframes - 1) / _hdr->fps : 0;
+    }
+
+    ///Sample clip at given time
+    //@param loop wrap the time around the clip duration, otherwise clamp
+    //@param out [out] pose, resized to the clip
+    //@param cur optional cursor for sequential playback
+    void sample( float time, bool loop, anim_pose& out, clip_cursor* cur = 0 ) const
+    {
+        const uint nb = bone_count();
+        if (out.nbones != nb)
+            out.resize(nb);
+
+        const uint nf = frame_count();
+        if (!nf)
+            return;
+
+        if (cur && cur->key.size() != 2 * nb) {
+            cur->key.resize(2 * nb);
+            ::memset(cur->key.ptr(), 0, cur->key.size() * sizeof(uint16));
+        }
+
+        float ft = time * _hdr->fps;
+        if (loop && nf > 1) {
+            float n = float(nf - 1);
+            ft = ft - n * floorf(ft / n);
+        }
+        ft = glm::clamp(ft, 0.0f, float(nf - 1));
+
+        const uint s = out.stride;
+        float* p = out.data.ptr();
+
+        for (uint b = 0; b < nb; ++b)
+        {
+            //rotation
+            const anim_blob::track& tr = _tracks[b];
+            const uint16* frames = (const uint16*)(_base + tr.offset);
+            const uint16* values = frames + tr.nkeys;
+
+            quat q;
+            if (tr.nkeys == 1)
+                q = anim_blob::unpack_quat(values);
+            else {
+                float t;
+                uint k = find(frames, tr.nkeys, ft, cur ? cur->key.ptr() + b : 0, t);
+                quat a = anim_blob::unpack_quat(values + 3 * k);
+                quat c = anim_blob::unpack_quat(values + 3 * k + 3);
+                q = nlerp(a, c, t);
+            }
+
+            p[b] = q.x;
+            p[s + b] = q.y;
+            p[2 * s + b] = q.z;
+            p[3 * s + b] = q.w;
+
+            //translation
+            const anim_blob::track& tp = _tracks[nb + b];
+            frames = (const uint16*)(_base + tp.offset);
+            values = frames + tp.nkeys;
+
+            if (tp.nkeys == 1) {
+                for (uint c = 0; c < 3; ++c)
+                    p[(4 + c) * s + b] = tp.min[c] + values[c] * tp.scale[c];
+            }
+            else {
+                float t;
+                uint k = find(frames, tp.nkeys, ft, cur ? cur->key.ptr() + nb + b : 0, t);
+                const uint16* v0 = values + 3 * k;
+                for (uint c = 0; c < 3; ++c) {
+                    float a = v0[c], d = v0[c + 3];
+                    p[(4 + c) * s + b] = tp.min[c] + (a + (d - a) * t) * tp.scale[c];
+                }
+            }
+        }
+    }
+
+    static quat nlerp( const quat& a, quat b, float t )
+    {
+        if (glm::dot(a, b) < 0)
+            b = -b;
+        return glm::normalize(quat(
+            a.w + (b.w - a.w) * t,
+            a.x + (b.x - a.x) * t,
+            a.y + (b.y - a.y) * t,
+            a.z + (b.z - a.z) * t));
+    }
+
+private:
+
+    ///Find key segment containing frame time
+    //@param cache optional cached segment index, updated
+    //@param t [out] interpolation factor within the segment
+    //@return index of the first key of the segment
+    static uint find( const uint16* frames, uint nkeys, float ft, uint16* cache, float& t )
+    {
+        uint k;
+        if (cache && *cache + 1 < nkeys && frames[*cache] <= ft && ft <= frames[*cache + 1])
+            k = *cache;
+        else if (cache && *cache + 2 < nkeys && frames[*cache + 1] <= ft && ft <= frames[*cache + 2])
+            k = *cache + 1;
+        else {
+            uint lo = 0, hi = nkeys - 1;
+            while (hi - lo > 1) {
+                uint mid = (lo + hi) >> 1;
+                if (frames[mid] <= ft)
+                    lo = mid;
+                else
+                    hi = mid;
+            }
+            k = lo;
+        }
+
+        if (cache)
+            *cache = uint16(k);
+
+        t = (ft - frames[k]) / float(frames[k + 1] - frames[k]);
+        return k;
+    }
+
+    const uint8* _base = 0;
+    const anim_blob::header* _hdr = 0;
+    const anim_blob::track* _tracks = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class anim_codec
+{
+public:
+
+    ///Error budget
+    struct params
+    {
+        float rot_error = 0.002f;       //< max rotation error [rad], above the 48 bit quantization error
+        float pos_error = 0.0005f;      //< max translation error [m]
+    };
+
+    ///Encoding statistics
+    struct stats
+    {
+        uint raw_bytes = 0;             //< size of the source clip frames
+        uint compressed_bytes = 0;      //< blob size
+        float ratio = 0;                //< raw_bytes / compressed_bytes
+        uint constant_tracks = 0;       //< tracks stored as a single key
+        uint raw_keys = 0;              //< keys in the source, per track
+        uint keys = 0;                  //< keys stored
+        float max_rot_error = 0;        //< max decoded rotation error [rad]
+        float max_pos_error = 0;        //< max decoded translation error [m]
+    };
+
+    ///Decoding speed
+    struct profile_result
+    {
+        float raw_ns_per_bone = 0;      //< anim_sampler on the source clip
+        float compressed_ns_per_bone = 0; //< compressed_clip with a cursor
+    };
+
+    ///Compress clip into a blob
+    //@param blob [out] compressed clip
+    //@param st optional statistics
+    //@return false if the clip has no frames or too many frames (max 65535)
+    static bool encode( const anim_clip& clip, const params& par, coid::dynarray<uint8>& blob, stats* st = 0 )
+    {
+        const uint nb = clip.bone_count();
+        const uint nf = clip.frame_count();
+        if (nf == 0 || nf > 0xffff)
+            return false;
+
+        stats s;
+        s.raw_bytes = nb * nf * 7 * uint(sizeof(float));
+        s.raw_keys = 2 * nb * nf;
+
+        coid::dynarray<anim_blob::track> tracks;
+        tracks.resize(2 * nb);
+        ::memset(tracks.ptr(), 0, tracks.size() * sizeof(anim_blob::track));
+
+        coid::dynarray<uint16> data;
+        coid::dynarray<uint16> keys;
+        coid::dynarray<uint16> qv;
+        coid::dynarray<quat> src_rot, dec_rot;
+        coid::dynarray<float3> src_pos, dec_pos;
+
+        const uint stride = clip.stride();
+        uint data_start = uint(sizeof(anim_blob::header) + tracks.size() * sizeof(anim_blob::track));
+
+        for (uint b = 0; b < nb; ++b)
+        {
+            //rotation track
+            src_rot.resize(nf);
+            dec_rot.resize(nf);
+            qv.resize(3 * nf);
+            for (uint f = 0; f < nf; ++f) {
+                const float* p = clip.frame_ptr(f) + b;
+                src_rot[f] = glm::normalize(quat(p[3 * stride], p[0], p[stride], p[2 * stride]));
+                anim_blob::pack_quat(src_rot[f], qv.ptr() + 3 * f);
+                dec_rot[f] = anim_blob::unpack_quat(qv.ptr() + 3 * f);
+            }
+
+            auto rot_err = [&](uint k0, uint k1, uint f) {
+                float t = k1 > k0 ? (f - k0) / float(k1 - k0) : 0.0f;
+                return rot_error(compressed_clip::nlerp(dec_rot[k0], dec_rot[k1], t), src_rot[f]);
+            };
+
+            anim_blob::track& tr = tracks[b];
+            tr.offset = data_start + uint(data.size() * sizeof(uint16));
+            s.max_rot_error = glm::max(s.max_rot_error, fit(nf, par.rot_error, rot_err, keys));
+            tr.nkeys = uint(keys.size());
+            emit(keys, qv.ptr(), data);
+
+            //translation track
+            src_pos.resize(nf);
+            dec_pos.resize(nf);
+            float3 lo(FLT_MAX), hi(-FLT_MAX);
+            for (uint f = 0; f < nf; ++f) {
+                const float* p = clip.frame_ptr(f) + b;
+                src_pos[f] = float3(p[4 * stride], p[5 * stride], p[6 * stride]);
+                lo = glm::min(lo, src_pos[f]);
+                hi = glm::max(hi, src_pos[f]);
+            }
+
+            anim_blob::track& tp = tracks[nb + b];
+            for (uint c = 0; c < 3; ++c) {
+                tp.min[c] = nf ? lo[c] : 0;
+                tp.scale[c] = nf ? (hi[c] - lo[c]) / 65535.0f : 0;
+            }
+
+            for (uint f = 0; f < nf; ++f) {
+                for (uint c = 0; c < 3; ++c) {
+                    uint16 q = tp.scale[c] > 0 ? uint16((src_pos[f][c] - tp.min[c]) / tp.scale[c] + 0.5f) : 0;
+                    qv[3 * f + c] = q;
+                    dec_pos[f][c] = tp.min[c] + q * tp.scale[c];
+                }
+            }
+
+            auto pos_err = [&](uint k0, uint k1, uint f) {
+                float t = k1 > k0 ? (f - k0) / float(k1 - k0) : 0.0f;
+                return glm::length(glm::mix(dec_pos[k0], dec_pos[k1], t) - src_pos[f]);
+            };
+
+            tp.offset = data_start + uint(data.size() * sizeof(uint16));
+            s.max_pos_error = glm::max(s.max_pos_error, fit(nf, par.pos_error, pos_err, keys));
+            tp.nkeys = uint(keys.size());
+            emit(keys, qv.ptr(), data);
+        }
+
+        for (uint i = 0; i < tracks.size(); ++i) {
+            s.keys += tracks[i].nkeys;
+            s.constant_tracks += tracks[i].nkeys == 1;
+        }
+
+        //assemble the blob
+        uint size = data_start + uint(data.size() * sizeof(uint16));
+        blob.resize(size);
+
+        anim_blob::header* h = (anim_blob::header*)blob.ptr();
+        h->magic = anim_blob::MAGIC;
+        h->version = anim_blob::VERSION;
+        h->size = size;
+        h->nbones = nb;
+        h->nframes = nf;
+        h->fps = clip.fps();
+
+        ::memcpy(h + 1, tracks.ptr(), tracks.size() * sizeof(anim_blob::track));
+        ::memcpy(blob.ptr() + data_start, data.ptr(), data.size() * sizeof(uint16));
+
+        s.compressed_bytes = size;
+        s.ratio = size ? s.raw_bytes / float(size) : 0;
+        if (st)
+            *st = s;
+        return true;
+    }
+
+    ///Measure decoding time of the source and compressed clips
+    //@param iterations number of sequential playback samples
+    static profile_result profile( const anim_clip& clip, const compressed_clip& cc, uint iterations = 1000 )
+    {
+        profile_result r;
+        uint nb = clip.bone_count();
+        if (!nb || !iterations)
+            return r;
+
+        anim_pose pose;
+        clip_cursor cur;
+        float dt = 1.0f / (clip.fps() * 1.7f);
+
+        typedef std::chrono::high_resolution_clock clock;
+
+        auto t0 = clock::now();
+        for (uint i = 0; i < iterations; ++i)
+            anim_sampler::sample(clip, i * dt, true, pose);
+        auto t1 = clock::now();
+        for (uint i = 0; i < iterations; ++i)
+            cc.sample(i * dt, true, pose, &cur);
+        auto t2 = clock::now();
+
+        float n = float(iterations) * nb;
+        r.raw_ns_per_bone = std::chrono::duration<float, std::nano>(t1 - t0).count() / n;
+        r.compressed_ns_per_bone = std::chrono::duration<float, std::nano>(t2 - t1).count() / n;
+        return r;
+    }
+
+private:
+
+    static float rot_error( const quat& a, const quat& b ) {
+        float d = fabsf(glm::dot(a, b));
+        return 2.0f * acosf(glm::min(d, 1.0f));
+    }
+
+    ///Greedy key reduction
+    //@param tol error budget
+    //@param err functor err(k0, k1, f) returning the error of frame f interpolated between keys k0 and k1
+    //@param keys [out] kept frames, a single key for constant tracks
+    //@return max error of the kept keys
+    template <class Fn>
+    static float fit( uint nf, float tol, Fn err, coid::dynarray<uint16>& keys )
+    {
+        keys.reset();
+        *keys.add() = 0;
+
+        //constant track: the first key represents all frames
+        float emax = 0;
+        for (uint f = 0; f < nf && emax <= tol; ++f)
+            emax = glm::max(emax, err(0, 0, f));
+        if (nf < 2 || emax <= tol)
+            return emax;
+
+        auto segment = [&](uint k0, uint k1) {
+            float e = 0;
+            for (uint f = k0 + 1; f < k1 && e <= tol; ++f)
+                e = glm::max(e, err(k0, k1, f));
+            return e;
+        };
+
+        emax = glm::max(err(0, 0, 0), err(nf - 1, nf - 1, nf - 1));
+
+        uint k0 = 0;
+        uint k1 = 1;
+        float e = 0;
+        while (k1 + 1 < nf) {
+            float en = segment(k0, k1 + 1);
+            if (en <= tol) {
+                ++k1;
+                e = en;
+            }
+            else {
+                *keys.add() = uint16(k1);
+                emax = glm::max(emax, glm::max(e, err(k1, k1, k1)));
+                k0 = k1;
+                k1 = k0 + 1;
+                e = 0;
+            }
+        }
+        *keys.add() = uint16(nf - 1);
+        return glm::max(emax, e);
+    }
+
+    ///Copy keys and their values into the data stream
+    static void emit( const coid::dynarray<uint16>& keys, const uint16* qv, coid::dynarray<uint16>& data )
+    {
+        uint n = uint(keys.size());
+        uint16* d = data.add(4 * n);
+        for (uint i = 0; i < n; ++i)
+            d[i] = keys[i];
+        for (uint i = 0; i < n; ++i) {
+            const uint16* v = qv + 3 * keys[i];
+            d[n + 3 * i] = v[0];
+            d[n + 3 * i + 1] = v[1];
+            d[n + 3 * i + 2] = v[2];
+        }
+    }
+};
+
+} //namespace ot
+
+#endif //__OT_ANIM_CODEC_H__
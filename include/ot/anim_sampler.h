@@ -0,0 +1,331 @@
+#pragma once
+#ifndef __OT_ANIM_SAMPLER_H__
+#define __OT_ANIM_SAMPLER_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+
+#include <immintrin.h>
+
+#include "geomob.h"
+#include "animation.h"
+#include "animation_stack.h"
+#include "geom_types.h"
+#include "glm/glm_ext.h"
+
+/**
+    Plugin-side animation sampling for crowds of characters.
+
+    anim_clip holds the local bone transforms of an animation for every
+    frame in SoA layout: per frame, separate planes of the rotation x/y/z/w
+    and translation x/y/z components, padded to a multiple of 8 bones.
+    anim_sampler::sample interpolates two frames for all bones at once,
+    quaternions by normalized lerp (hemisphere corrected) and translations
+    by lerp, 8 bones per iteration when built with AVX2 (fused multiply-add
+    only if FMA is enabled too), scalar otherwise. The resulting anim_pose
+    is written into geomob::get_bone_local_ptr() as bone_data (rotation and
+    dual quaternion) of a geomob in AnimExplicit mode.
+
+    The key frame format of ot::animation (pkg::animation_key_frame) is
+    opaque to plugins, so clips are baked through the host: capture() steps
+    an animation_stack over all frames of the animation and records the
+    local bone transforms produced by animate(). Clips can also be filled
+    directly with set_key.
+
+    Sampling only reads the clip, so it can run on worker threads; the bone
+    pointers should be fetched on the main thread.
+
+    Example:
+        ot::anim_clip walk;
+        walk.capture(*geom, *anim, *stack, anim_id);
+
+        //worker thread
+        ot::anim_pose pose;
+        ot::anim_sampler::sample(walk, t, true, pose);
+        ot::anim_sampler::write(pose, bones, nbones);
+**/
+
+namespace ot {
+
+///Local bone transforms of all bones of a skeleton, SoA
+struct anim_pose
+{
+    enum { PLANES = 7 };                //< rx, ry, rz, rw, tx, ty, tz
+
+    uint nbones = 0;
+    uint stride = 0;                    //< nbones padded to 8
+    coid::dynarray<float> data;         //< PLANES planes of stride floats
+
+    void resize( uint n ) {
+        nbones = n;
+        stride = (n + 7) & ~7U;
+        data.resize(PLANES * stride);
+        ::memset(data.ptr(), 0, data.size() * sizeof(float));
+    }
+
+    float* plane( uint i ) { return data.ptr() + i * stride; }
+    const float* plane( uint i ) const { return data.ptr() + i * stride; }
+
+    quat rot( uint b ) const {
+        const float* p = data.ptr() + b;
+        return quat(p[3 * stride], p[0], p[stride], p[2 * stride]);
+    }
+
+    float3 pos( uint b ) const {
+        const float* p = data.ptr() + b;
+        return float3(p[4 * stride], p[5 * stride], p[6 * stride]);
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///Baked animation, local bone transforms per frame in SoA
+class anim_clip
+{
+public:
+
+    enum { PLANES = anim_pose::PLANES };
+
+    void resize( uint nbones, uint nframes, float fps )
+    {
+        _nbones = nbones;
+        _stride = (nbones + 7) & ~7U;
+        _nframes = nframes;
+        _fps = fps;
+        _data.resize(uints(PLANES) * _stride * nframes);
+        ::memset(_data.ptr(), 0, _data.size() * sizeof(float));
+    }
+
+    uint bone_count() const { return _nbones; }
+    uint frame_count() const { return _nframes; }
+    uint stride() const { return _stride; }
+    float fps() const { return _fps; }
+
+    //@return clip duration [s]
+    float duration() const { return _nframes > 1 ? (_nframes - 1) / _fps : 0; }
+
+    ///Set key of a bone in a frame
+    void set_key( uint frame, uint bone, const quat& rot, const float3& pos )
+    {
+        DASSERT(frame < _nframes && bone < _nbones);
+        float* p = frame_ptr(frame) + bone;
+        p[0] = rot.x;
+        p[_stride] = rot.y;
+        p[2 * _stride] = rot.z;
+        p[3 * _stride] = rot.w;
+        p[4 * _stride] = pos.x;
+        p[5 * _stride] = pos.y;
+        p[6 * _stride] = pos.z;
+    }
+
+    ///Bake animation through the host animation stack
+    //@param geom geomob the animation is applied to, switched to AnimExplicit mode
+    //@param anim loaded animation
+    //@param stack animation stack of the geomob
+    //@param anim_id id of the animation in the stack
+    //@return false if the animation is not ready
+    bool capture( geomob& geom, animation& anim, animation_stack& stack, uint anim_id )
+    {
+        if (!anim.is_ready() || !stack.is_ready())
+            return false;
+
+        uint nframes = anim.get_frame_count();
+        uint nbones = geom.get_num_bones();
+        if (!nframes || !nbones)
+            return false;
+
+        resize(nbones, nframes, float(anim.get_fps() ? anim.get_fps() : 30));
+        geom.set_animate_mode(pkg::AnimExplicit);
+
+        for (uint f = 0; f < nframes; ++f)
+        {
+            stack.set_animation_time(anim_id, nframes > 1 ? f / float(nframes - 1) : 0.0f);
+            geom.animate();
+
+            const pkg::bone_data* bd = geom.get_bone_local_ptr();
+            for (uint b = 0; b < nbones; ++b)
+                set_key(f, b, bd[b]._rot, glm::dquat_to_trans(bd[b]._rot, bd[b]._dual));
+        }
+
+        return true;
+    }
+
+    const float* frame_ptr( uint frame ) const { return _data.ptr() + uints(frame) * PLANES * _stride; }
+    float* frame_ptr( uint frame ) { return _data.ptr() + uints(frame) * PLANES * _stride; }
+
+private:
+
+    uint _nbones = 0;
+    uint _stride = 0;
+    uint _nframes = 0;
+    float _fps = 30;
+    coid::dynarray<float> _data;        //< frames of PLANES planes of stride floats
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class anim_sampler
+{
+public:
+
+    ///Sample clip at given time
+    //@param time clip time [s]
+    //@param loop wrap the time around the clip duration, otherwise clamp
+    //@param out [out] pose, resized to the clip
+    static void sample( const anim_clip& clip, float time, bool loop, anim_pose& out )
+    {
+        if (out.nbones != clip.bone_count())
+            out.resize(clip.bone_count());
+
+        uint nf = clip.frame_count();
+        if (!nf)
+            return;
+
+        float ft = time * clip.fps();
+        if (loop && nf > 1) {
+            float n = float(nf - 1);
+            ft = ft - n * floorf(ft / n);
+        }
+        ft = glm::clamp(ft, 0.0f, float(nf - 1));
+
+        uint f0 = uint(ft);
+        uint f1 = f0 + 1 < nf ? f0 + 1 : f0;
+        float t = ft - f0;
+
+        interpolate(clip.frame_ptr(f0), clip.frame_ptr(f1), clip.stride(), t, out.data.ptr());
+    }
+
+    ///Interpolate between two SoA poses with the same layout
+    //@param t interpolation factor 0..1
+    //@param out [out] may be one of the inputs
+    static void lerp( const anim_pose& a, const anim_pose& b, float t, anim_pose& out )
+    {
+        DASSERT(a.stride == b.stride);
+        if (out.nbones != a.nbones)
+            out.resize(a.nbones);
+        interpolate(a.data.ptr(), b.data.ptr(), a.stride, t, out.data.ptr());
+    }
+
+    ///Write pose into geomob local bones
+    //@param dst bones from geomob::get_bone_local_ptr()
+    //@param n number of bones to write
+    static void write( const anim_pose& pose, pkg::bone_data* dst, uint n )
+    {
+        if (n > pose.nbones)
+            n = pose.nbones;
+
+        const uint s = pose.stride;
+        const float* p = pose.data.ptr();
+
+        for (uint b = 0; b < n; ++b) {
+            quat r(p[3 * s + b], p[b], p[s + b], p[2 * s + b]);
+            float3 t(p[4 * s + b], p[5 * s + b], p[6 * s + b]);
+            dst[b]._rot = r;
+            dst[b]._dual = glm::to_dquat(r, t);
+        }
+    }
+
+private:
+
+#ifdef __AVX2__
+    ///a * b + c, fused if the target has FMA (MSVC /arch:AVX2 implies it)
+    static __m256 madd( __m256 a, __m256 b, __m256 c ) {
+#if defined(__FMA__) || defined(_MSC_VER)
+        return _mm256_fmadd_ps(a, b, c);
+#else
+        return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+    }
+#endif
+
+    ///Interpolate stride bones of two SoA frames
+    static void interpolate( const float* a, const float* b, uint stride, float t, float* out )
+    {
+        uint i = 0;
+
+#ifdef __AVX2__
+        const __m256 vt = _mm256_set1_ps(t);
+        const __m256 sign = _mm256_set1_ps(-0.0f);
+        const __m256 one = _mm256_set1_ps(1.0f);
+
+        for (; i + 8 <= stride; i += 8)
+        {
+            __m256 ax = _mm256_loadu_ps(a + i);
+            __m256 ay = _mm256_loadu_ps(a + stride + i);
+            __m256 az = _mm256_loadu_ps(a + 2 * stride + i);
+            __m256 aw = _mm256_loadu_ps(a + 3 * stride + i);
+            __m256 bx = _mm256_loadu_ps(b + i);
+            __m256 by = _mm256_loadu_ps(b + stride + i);
+            __m256 bz = _mm256_loadu_ps(b + 2 * stride + i);
+            __m256 bw = _mm256_loadu_ps(b + 3 * stride + i);
+
+            //flip b to the hemisphere of a
+            __m256 d = _mm256_mul_ps(ax, bx);
+            d = madd(ay, by, d);
+            d = madd(az, bz, d);
+            d = madd(aw, bw, d);
+            __m256 s = _mm256_and_ps(d, sign);
+            bx = _mm256_xor_ps(bx, s);
+            by = _mm256_xor_ps(by, s);
+            bz = _mm256_xor_ps(bz, s);
+            bw = _mm256_xor_ps(bw, s);
+
+            __m256 qx = madd(_mm256_sub_ps(bx, ax), vt, ax);
+            __m256 qy = madd(_mm256_sub_ps(by, ay), vt, ay);
+            __m256 qz = madd(_mm256_sub_ps(bz, az), vt, az);
+            __m256 qw = madd(_mm256_sub_ps(bw, aw), vt, aw);
+
+            __m256 l = _mm256_mul_ps(qx, qx);
+            l = madd(qy, qy, l);
+            l = madd(qz, qz, l);
+            l = madd(qw, qw, l);
+            //padding lanes are zero, keep them finite
+            __m256 inv = _mm256_div_ps(one, _mm256_sqrt_ps(_mm256_max_ps(l, _mm256_set1_ps(1e-30f))));
+
+            _mm256_storeu_ps(out + i, _mm256_mul_ps(qx, inv));
+            _mm256_storeu_ps(out + stride + i, _mm256_mul_ps(qy, inv));
+            _mm256_storeu_ps(out + 2 * stride + i, _mm256_mul_ps(qz, inv));
+            _mm256_storeu_ps(out + 3 * stride + i, _mm256_mul_ps(qw, inv));
+
+            for (uint k = 4; k < 7; ++k) {
+                __m256 va = _mm256_loadu_ps(a + k * stride + i);
+                __m256 vb = _mm256_loadu_ps(b + k * stride + i);
+                _mm256_storeu_ps(out + k * stride + i, madd(_mm256_sub_ps(vb, va), vt, va));
+            }
+        }
+#endif
+
+        for (; i < stride; ++i)
+        {
+            float ax = a[i], ay = a[stride + i], az = a[2 * stride + i], aw = a[3 * stride + i];
+            float bx = b[i], by = b[stride + i], bz = b[2 * stride + i], bw = b[3 * stride + i];
+
+            if (ax * bx + ay * by + az * bz + aw * bw < 0) {
+                bx = -bx; by = -by; bz = -bz; bw = -bw;
+            }
+
+            float qx = ax + (bx - ax) * t;
+            float qy = ay + (by - ay) * t;
+            float qz = az + (bz - az) * t;
+            float qw = aw + (bw - aw) * t;
+
+            float l = qx * qx + qy * qy + qz * qz + qw * qw;
+            float inv = l > 1e-30f ? 1.0f / sqrtf(l) : 0.0f;
+
+            out[i] = qx * inv;
+            out[stride + i] = qy * inv;
+            out[2 * stride + i] = qz * inv;
+            out[3 * stride + i] = qw * inv;
+
+            for (uint k = 4; k < 7; ++k) {
+                float va = a[k * stride + i];
+                out[k * stride + i] = va + (b[k * stride + i] - va) * t;
+            }
+        }
+    }
+};
+
+} //namespace ot
+
+#endif //__OT_ANIM_SAMPLER_H__
@@ -0,0 +1,276 @@
+#pragma once
+#ifndef __OT_ANIM_SCHEDULER_H__
+#define __OT_ANIM_SCHEDULER_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+
+#include <chrono>
+
+#include "anim_sampler.h"
+#include "glm/glm_ext.h"
+
+/**
+    Animation LOD and update rate scheduler for crowds.
+
+    Each character is assigned an animation LOD from its projected screen
+    size: the LOD determines the update period (every frame, every 2nd,
+    4th, ... frame) and, for characters animated from baked clips, the
+    number of bones written. Lower LODs write only the first bones of the
+    clip, so the clip bones must be ordered by importance: the skeleton
+    order of the model, parents before children, keeps the root, spine and
+    limb roots and drops the fingers, toes and facial bones at the end.
+    Bones not written keep their last written pose. Characters of the same
+    period are spread over the frames by a per-character phase, so only
+    1/period of them update in any frame and the cost stays flat instead of
+    spiking.
+
+    Characters are animated either through the host, by setting the
+    animation time of their animation_stack and calling geomob::animate()
+    (the geomob is switched to AnimExplicit mode), or from an anim_clip
+    sampled by anim_sampler and written directly into the local bones.
+    Updates are done in batches: all stack times are set first, then all
+    geomobs animated.
+
+    The time spent and the number of characters and bones updated in the
+    last frame are reported in stats.
+
+    Example:
+        ot::anim_scheduler sched;
+        uint id = sched.add_stack(geom, stack, anim_id, duration, 1.0f);
+
+        //each frame
+        sched.set_pos(id, pos);
+        sched.update(camera_pos, proj_scale, dt);
+        float ms = sched.get_stats().ms;
+**/
+
+namespace ot {
+
+////////////////////////////////////////////////////////////////////////////////
+class anim_scheduler
+{
+public:
+
+    enum { MAX_LODS = 4 };
+
+    ///LOD level
+    struct lod
+    {
+        float min_screen_size;          //< min projected size for the LOD [px]
+        uint period;                    //< update every n-th frame, power of two
+        float bone_fraction;            //< fraction of bones written (clip mode), the first ones in clip order
+    };
+
+    ///Scheduler configuration
+    struct params
+    {
+        lod lods[MAX_LODS] = {
+            { 200.0f, 1, 1.0f },
+            { 60.0f, 2, 1.0f },
+            { 20.0f, 4, 0.5f },
+            { 0.0f, 8, 0.25f },
+        };
+        float cull_screen_size = 1.0f;  //< below this size the character is not animated [px]
+    };
+
+    ///Counters of the last update
+    struct stats
+    {
+        uint characters = 0;            //< registered characters
+        uint updated = 0;               //< characters updated this frame
+        uint culled = 0;                //< characters too small to animate
+        uint bones = 0;                 //< bones written in clip mode
+        uint per_lod[MAX_LODS] = {};    //< characters per LOD
+        float ms = 0;                   //< time spent in update [ms]
+    };
+
+    anim_scheduler()
+        : anim_scheduler(params())
+    {}
+
+    explicit anim_scheduler( const params& p )
+        : _params(p)
+    {}
+
+    params& get_params() { return _params; }
+
+    ///Add character animated through its animation stack
+    //@param anim_id id of the animation in the stack
+    //@param duration animation duration [s]
+    //@param radius bounding radius of the character [m]
+    //@return character id
+    uint add_stack( const iref<geomob>& geom, const iref<animation_stack>& stack, uint anim_id, float duration, float radius )
+    {
+        geom->set_animate_mode(pkg::AnimExplicit);
+
+        uint id = add(geom, radius);
+        character& c = _chars[id];
+        c.stack = stack;
+        c.anim_id = anim_id;
+        c.duration = duration;
+        return id;
+    }
+
+    ///Add character animated from a baked clip
+    //@param clip clip, must stay valid while the character is registered
+    //@return character id
+    uint add_clip( const iref<geomob>& geom, const anim_clip* clip, float radius )
+    {
+        geom->set_animate_mode(pkg::AnimExplicit);
+
+        uint id = add(geom, radius);
+        character& c = _chars[id];
+        c.clip = clip;
+        c.duration = clip->duration();
+        return id;
+    }
+
+    ///Remove character, the id of the last character is moved to this one
+    //@return id of the character that took the removed id, or UMAX32
+    uint remove( uint id )
+    {
+        uint last = uint(_chars.size()) - 1;
+        if (id != last)
+            _chars[id] = _chars[last];
+        _chars.resize(last);
+        return id != last ? last : UMAX32;
+    }
+
+    //@{ per character state
+    void set_pos( uint id, const double3& pos ) { _chars[id].pos = pos; }
+    void set_speed( uint id, float speed ) { _chars[id].speed = speed; }
+    void set_time( uint id, float time ) { _chars[id].time = time; _chars[id].elapsed = 0; _chars[id].dirty = true; }
+    uint get_lod( uint id ) const { return _chars[id].lod; }
+    //@}
+
+    ///Assign LODs and animate characters due in this frame
+    //@param camera camera position
+    //@param proj_scale projection scale, viewport height / (2 tan(fov/2)) [px]
+    //@param dt frame time [s]
+    void update( const double3& camera, float proj_scale, float dt )
+    {
+        auto t0 = std::chrono::high_resolution_clock::now();
+
+        _stats = stats();
+        _stats.characters = uint(_chars.size());
+
+        const uint n = uint(_chars.size());
+        _due.reset();
+
+        for (uint i = 0; i < n; ++i)
+        {
+            character& c = _chars[i];
+            c.elapsed += dt * c.speed;
+
+            float dist = float(glm::length(c.pos - camera));
+            float size = dist > c.radius ? 2 * c.radius * proj_scale / dist : 1e9f;
+
+            if (size < _params.cull_screen_size) {
+                ++_stats.culled;
+                continue;
+            }
+
+            uint l = 0;
+            while (l + 1 < MAX_LODS && size < _params.lods[l].min_screen_size)
+                ++l;
+            c.lod = uint8(l);
+            ++_stats.per_lod[l];
+
+            uint period = _params.lods[l].period;
+            if (!c.dirty && ((_frame + c.phase) & (period - 1)))
+                continue;
+
+            c.time += c.elapsed;
+            c.elapsed = 0;
+            c.dirty = false;
+            if (c.duration > 0)
+                c.time = fmodf(c.time, c.duration);
+
+            *_due.add() = i;
+        }
+
+        _stats.updated = uint(_due.size());
+
+        //host animated characters: set all times first, then animate in a batch
+        for (uint k = 0; k < _due.size(); ++k) {
+            const character& c = _chars[_due[k]];
+            if (c.stack)
+                c.stack->set_animation_time(c.anim_id, c.duration > 0 ? c.time / c.duration : 0.0f);
+        }
+
+        for (uint k = 0; k < _due.size(); ++k)
+        {
+            character& c = _chars[_due[k]];
+            if (c.stack) {
+                c.geom->animate();
+                continue;
+            }
+
+            //clip animated characters
+            anim_sampler::sample(*c.clip, c.time, true, _pose);
+
+            uint nb = uint(ceilf(c.clip->bone_count() * _params.lods[c.lod].bone_fraction));
+            anim_sampler::write(_pose, c.geom->get_bone_local_ptr(), nb);
+            _stats.bones += nb;
+        }
+
+        ++_frame;
+
+        auto t1 = std::chrono::high_resolution_clock::now();
+        _stats.ms = std::chrono::duration<float, std::milli>(t1 - t0).count();
+    }
+
+    const stats& get_stats() const { return _stats; }
+
+private:
+
+    struct character
+    {
+        iref<geomob> geom;
+        iref<animation_stack> stack;    //< host animated, or null
+        const anim_clip* clip = 0;      //< clip animated, or null
+        uint anim_id = 0;
+
+        double3 pos = double3(0);
+        float radius = 1;
+        float speed = 1;                //< animation speed
+        float duration = 0;             //< animation duration [s]
+        float time = 0;                 //< animation time [s]
+        float elapsed = 0;              //< time accumulated since the last update [s]
+
+        uint8 lod = 0;
+        uint8 phase = 0;                //< frame offset for staggering
+        bool dirty = true;              //< time changed externally, update in the next frame
+    };
+
+    uint add( const iref<geomob>& geom, float radius )
+    {
+        uint id = uint(_chars.size());
+        character* c = _chars.add();
+        c->geom = geom;
+        c->radius = radius;
+        c->phase = uint8(_next_phase++);
+        return id;
+    }
+
+private:
+
+    params _params;
+
+    coid::dynarray<character> _chars;
+    coid::dynarray<uint> _due;          //< characters updated this frame
+    anim_pose _pose;
+
+    uint _frame = 0;
+    uint _next_phase = 0;
+
+    stats _stats;
+};
+
+} //namespace ot
+
+#endif //__OT_ANIM_SCHEDULER_H__
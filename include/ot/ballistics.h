@@ -0,0 +1,601 @@
+#pragma once
+#ifndef __OT_BALLISTICS_H__
+#define __OT_BALLISTICS_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "explosions.h"
+#include "environment.h"
+#include "igc.h"
+#include "cubeface.h"
+#include "glm/glm_ext.h"
+
+/**
+    Plugin-side ballistic projectile integrator.
+
+    Projectiles are kept in SoA arrays and integrated with gravity and
+    Mach-dependent drag from a standard drag function table (G1 or G7),
+    in the air mass moving with the wind. Each step is split into fixed
+    substeps; the segment travelled during the whole step is hit-tested for
+    all projectiles at once through a single ballistic_ray_query call.
+
+    Threading: step() is advance() followed by resolve(). advance() only
+    touches the projectile store and can run on a worker thread (see
+    ballistics_worker). resolve() runs the ray query and can run there too
+    only if the query is thread_safe(); the default igc_ray_query calls the
+    blocking igc::intersect and is resolved on the main thread. spawn(),
+    update_wind(), sync_visuals() and fetch_hits() talk to the engine and
+    must be called from the main thread while the step is not running.
+
+    Visual tracers are host tracers relaunched along the integrated path
+    every visual_sync period, each living only until the next resync. The
+    host has no collision-less tracers, so one can still land on its own
+    near the end of the flight; such landed_tracers() entries carry the
+    VISUAL_TRACER uservalue and should be ignored, the hit is reported by
+    fetch_hits().
+
+    Example:
+        ot::ballistics bal(ot::explosions::get());
+        ot::igc_ray_query rq(igc);
+        bal.set_ray_query(&rq);
+
+        ot::projectile_desc pd;
+        pd.pos = muzzle_pos;
+        pd.vel = muzzle_dir * 850.0f;
+        pd.mass = 0.0098f;
+        pd.caliber = 0.00782f;
+        pd.form_factor = 1.0f;
+        pd.drag = ot::drag_model::G7;
+        bal.spawn(pd);
+
+        //each frame
+        bal.update_wind(env);
+        bal.step(dt);
+        bal.sync_visuals();
+        bal.fetch_hits(hits);
+**/
+
+namespace ot {
+
+///Standard drag functions
+enum class drag_model : uint8 {
+    none,
+    G1,                                 //< flat-base projectile
+    G7,                                 //< long boat-tail projectile
+};
+
+///Drag coefficient as a function of Mach number
+//@note approximated standard tables, linear interpolation between nodes
+inline float drag_coefficient( drag_model model, float mach )
+{
+    struct node { float mach, cd; };
+
+    static const node G1[] = {
+        {0.00f, 0.2629f}, {0.50f, 0.2032f}, {0.60f, 0.2034f}, {0.70f, 0.2165f},
+        {0.80f, 0.2546f}, {0.90f, 0.3415f}, {0.95f, 0.4084f}, {1.00f, 0.4805f},
+        {1.05f, 0.5427f}, {1.10f, 0.5883f}, {1.20f, 0.6342f}, {1.30f, 0.6553f},
+        {1.40f, 0.6594f}, {1.50f, 0.6528f}, {1.75f, 0.6209f}, {2.00f, 0.5934f},
+        {2.50f, 0.5397f}, {3.00f, 0.5027f}, {4.00f, 0.4504f}, {5.00f, 0.4240f},
+    };
+
+    static const node G7[] = {
+        {0.00f, 0.1198f}, {0.50f, 0.1197f}, {0.60f, 0.1202f}, {0.70f, 0.1217f},
+        {0.80f, 0.1255f}, {0.85f, 0.1301f}, {0.90f, 0.1440f}, {0.95f, 0.1914f},
+        {1.00f, 0.3803f}, {1.05f, 0.4015f}, {1.10f, 0.4043f}, {1.20f, 0.3955f},
+        {1.30f, 0.3852f}, {1.50f, 0.3596f}, {1.75f, 0.3281f}, {2.00f, 0.2980f},
+        {2.50f, 0.2545f}, {3.00f, 0.2240f}, {4.00f, 0.1840f}, {5.00f, 0.1590f},
+    };
+
+    const node* t;
+    uint n;
+    switch (model) {
+    case drag_model::G1: t = G1; n = sizeof(G1) / sizeof(node); break;
+    case drag_model::G7: t = G7; n = sizeof(G7) / sizeof(node); break;
+    default: return 0;
+    }
+
+    if (mach >= t[n-1].mach)
+        return t[n-1].cd;
+
+    //tables are short, linear search
+    uint i = 1;
+    while (t[i].mach < mach)
+        ++i;
+
+    float f = (mach - t[i-1].mach) / (t[i].mach - t[i-1].mach);
+    return t[i-1].cd + (t[i].cd - t[i-1].cd) * f;
+}
+
+///Projectile launch parameters
+struct projectile_desc
+{
+    double3 pos;                        //< launch position (ECEF)
+    float3 vel;                         //< launch velocity (ECEF)
+    float mass = 0.01f;                 //< projectile mass [kg]
+    float caliber = 0.00762f;           //< projectile diameter [m]
+    float form_factor = 1.0f;           //< form factor relative to the drag model reference projectile
+    drag_model drag = drag_model::G7;
+    float timeout = 10.0f;              //< max flight time [s]
+    uint uservalue = 0;                 //< custom value returned with the hit
+
+    bool visual = true;                 //< launch a tracer for the projectile
+    float tracer_size = 0.2f;
+    float3 tracer_color = float3(1, 0.6f, 0.2f);
+};
+
+///Projectile hit
+struct projectile_hit
+{
+    double3 pos;                        //< hit position
+    float3 norm;                        //< surface normal
+    float3 vel;                         //< projectile velocity at impact
+    uint id;                            //< projectile id
+    uint uservalue;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///Batched ray query used for projectile hit testing
+class ballistic_ray_query
+{
+public:
+    virtual ~ballistic_ray_query() {}
+
+    ///Test segments
+    //@param from segment starts
+    //@param to segment ends
+    //@param n number of segments
+    //@param t [out] hit parameter along the segment in 0..1 range, <0 for no hit
+    //@param pos [out] hit positions
+    //@param norm [out] hit normals
+    virtual void intersect( const double3* from, const double3* to, uint n, float* t, double3* pos, float3* norm ) = 0;
+
+    //@return true if intersect() can be called from a worker thread
+    virtual bool thread_safe() const { return false; }
+};
+
+///Terrain ray query through ot::igc::intersect
+//@note the host call is blocking and main thread only, use for moderate projectile counts
+class igc_ray_query : public ballistic_ray_query
+{
+public:
+    explicit igc_ray_query( const iref<igc>& igc )
+        : _igc(igc)
+    {}
+
+    void intersect( const double3* from, const double3* to, uint n, float* t, double3* pos, float3* norm ) override
+    {
+        for (uint i = 0; i < n; ++i) {
+            double len = glm::length(to[i] - from[i]);
+            double d = len > 0
+                ? _igc->intersect(from[i], to[i], pos[i], norm[i])
+                : -1;
+            t[i] = d >= 0 ? float(d / len) : -1.0f;
+        }
+    }
+
+private:
+    iref<igc> _igc;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class ballistics
+{
+public:
+
+    enum {
+        VISUAL_TRACER = 0xfffffffe,     //< uservalue of the visual tracers
+    };
+
+    ///Integration setup
+    struct params
+    {
+        float max_substep = 1.0f / 120;     //< max integration substep [s]
+        float visual_sync = 0.25f;          //< period of tracer resynchronization [s]
+        float air_density = 1.225f;         //< sea level air density [kg/m3]
+        float scale_height = 8500.0f;       //< air density scale height [m]
+        double radius = rad_eq;             //< sea level radius for the altitude estimation
+    };
+
+    explicit ballistics( const iref<explosions>& exp )
+        : ballistics(exp, params())
+    {}
+
+    ballistics( const iref<explosions>& exp, const params& p )
+        : _exp(exp)
+        , _params(p)
+    {}
+
+    void set_ray_query( ballistic_ray_query* rq ) { _rq = rq; }
+
+    params& get_params() { return _params; }
+
+    //@return number of live projectiles
+    uint size() const { return uint(_id.size()); }
+
+    ///Spawn projectile
+    //@return projectile id
+    uint spawn( const projectile_desc& d )
+    {
+        DASSERT(!_pending);
+        uint id = _next_id++;
+
+        *_id.add() = id;
+        *_uservalue.add() = d.uservalue;
+        *_px.add() = d.pos.x;
+        *_py.add() = d.pos.y;
+        *_pz.add() = d.pos.z;
+        *_vx.add() = d.vel.x;
+        *_vy.add() = d.vel.y;
+        *_vz.add() = d.vel.z;
+
+        //0.5 * A * i / m, density and Cd applied during integration
+        float area = float(M_PI * 0.25) * d.caliber * d.caliber;
+        *_kdrag.add() = d.mass > 0 ? 0.5f * area * d.form_factor / d.mass : 0.0f;
+        *_model.add() = uint8(d.drag);
+        *_age.add() = 0;
+        *_timeout.add() = d.timeout;
+
+        float sync = _params.visual_sync * float(id % 16) / 16;    //stagger resyncs
+        *_sync.add() = sync;
+        *_tracer_size.add() = d.tracer_size;
+        *_tracer_color.add() = d.tracer_color;
+        *_tracer.add() = UMAX32;
+        if (d.visual)
+            _tracer.last() = launch_visual(uint(_id.size() - 1), sync);
+        return id;
+    }
+
+    ///Sample the wind profile from the environment, call from the main thread
+    void update_wind( const iref<environment>& env )
+    {
+        weather_params wp(0);
+        env->get_weather_params(wp);
+
+        float hdg = glm::radians(wp.wind_heading);
+        _wind_dir = float2(sinf(hdg), cosf(hdg));   //east, north
+
+        for (uint i = 0; i < WIND_SAMPLES; ++i)
+            _wind[i] = env->wind_speed_at_height(float(i) * WIND_STEP);
+    }
+
+    ///Advance all projectiles and resolve hits
+    //@param dt time step [s]
+    //@note can run on a worker thread only with a thread safe ray query
+    void step( float dt )
+    {
+        advance(dt);
+        resolve();
+    }
+
+    ///Integrate all projectiles over the step, without hit testing
+    //@param dt time step [s]
+    //@note can run on a worker thread, resolve() must follow before the store is modified
+    void advance( float dt )
+    {
+        DASSERT(!_pending);
+        uint n = size();
+        if (!n || dt <= 0)
+            return;
+
+        uint nsub = uint(ceilf(dt / _params.max_substep));
+        float h = dt / nsub;
+
+        _from.resize(n);
+        _vfrom.resize(n);
+        for (uint i = 0; i < n; ++i) {
+            _from[i] = double3(_px[i], _py[i], _pz[i]);
+            _vfrom[i] = float3(_vx[i], _vy[i], _vz[i]);
+        }
+
+        for (uint s = 0; s < nsub; ++s)
+            integrate(h, n);
+
+        _to.resize(n);
+        for (uint i = 0; i < n; ++i) {
+            _to[i] = double3(_px[i], _py[i], _pz[i]);
+            _age[i] += dt;
+            _sync[i] -= dt;
+        }
+
+        _pending = true;
+    }
+
+    ///Hit test the segments travelled in the last advance(), collect hits and expired projectiles
+    //@note main thread unless the ray query is thread_safe()
+    void resolve()
+    {
+        if (!_pending)
+            return;
+        _pending = false;
+
+        //one batched hit query for the whole step
+        uint n = size();
+        _t.resize(n);
+        _hpos.resize(n);
+        _hnorm.resize(n);
+
+        if (_rq)
+            _rq->intersect(_from.ptr(), _to.ptr(), n, _t.ptr(), _hpos.ptr(), _hnorm.ptr());
+        else
+            for (uint i = 0; i < n; ++i)
+                _t[i] = -1;
+
+        //collect hits and expired projectiles, compact the store
+        for (uint i = n; i-- > 0; )
+        {
+            if (_t[i] >= 0) {
+                projectile_hit* hit = _hits.add();
+                hit->pos = _hpos[i];
+                hit->norm = _hnorm[i];
+                //velocity at the hit, interpolated along the step
+                float3 v1(_vx[i], _vy[i], _vz[i]);
+                hit->vel = _vfrom[i] + (v1 - _vfrom[i]) * _t[i];
+                hit->id = _id[i];
+                hit->uservalue = _uservalue[i];
+                remove(i);
+            }
+            else if (_age[i] >= _timeout[i])
+                remove(i);
+        }
+    }
+
+    //@return true if resolve() can run on a worker thread
+    bool ray_query_thread_safe() const { return !_rq || _rq->thread_safe(); }
+
+    ///Resynchronize tracer visuals with the integrated state, call from the main thread
+    void sync_visuals()
+    {
+        for (uint i = 0; i < _dead_tracers.size(); ++i)
+            _exp->destroy_tracer(_dead_tracers[i]);
+        _dead_tracers.reset();
+
+        uint n = size();
+        for (uint i = 0; i < n; ++i)
+        {
+            if (_tracer[i] == UMAX32 || _sync[i] > 0)
+                continue;
+
+            _sync[i] += _params.visual_sync;
+            _tracer[i] = launch_visual(i, _sync[i]);
+        }
+    }
+
+    ///Fetch hits since the last call
+    //@param hits [out] swapped with the internal hit buffer
+    void fetch_hits( coid::dynarray<projectile_hit>& hits )
+    {
+        hits.reset();
+        hits.swap(_hits);
+    }
+
+private:
+
+    enum {
+        WIND_SAMPLES = 64,
+    };
+
+    static constexpr float WIND_STEP = 50.0f;   //< wind profile sampling step [m]
+
+    ///Launch or relaunch the visual tracer of a projectile
+    //@param until time to the next resync [s]
+    uint launch_visual( uint i, float until )
+    {
+        //live only until the next resync, so the host tracer doesn't outrun the integrated one
+        float timeout = glm::min(until + _params.visual_sync, _timeout[i] - _age[i]);
+
+        return _exp->launch_tracer(
+            double3(_px[i], _py[i], _pz[i]), float3(_vx[i], _vy[i], _vz[i]),
+            _tracer_size[i], _tracer_color[i], 0.5f, 0.2f, glm::max(timeout, 0.001f), _age[i],
+            _tracer[i], entity_handle(), VISUAL_TRACER);
+    }
+
+    ///Single substep for all projectiles
+    void integrate( float h, uint n )
+    {
+        const float g = 9.80665f;
+
+        for (uint i = 0; i < n; ++i)
+        {
+            double3 p(_px[i], _py[i], _pz[i]);
+            float3 v(_vx[i], _vy[i], _vz[i]);
+
+            double r = glm::length(p);
+            float3 up = float3(p / r);
+            float alt = float(r - _params.radius);
+
+            //air properties at altitude
+            float rho = _params.air_density * expf(-glm::max(alt, 0.0f) / _params.scale_height);
+            float sound = glm::max(295.0f, 340.3f - 0.0041f * alt);
+
+            //air velocity
+            float3 east = glm::normalize0(float3(-up.y, up.x, 0));
+            float3 north = glm::cross(up, east);
+            float3 wind = (_wind_dir.x * east + _wind_dir.y * north) * wind_speed(alt);
+
+            float3 vr = v - wind;
+            float speed = glm::length(vr);
+
+            float3 acc = -g * up;
+            if (speed > 0 && _kdrag[i] > 0) {
+                float cd = drag_coefficient(drag_model(_model[i]), speed / sound);
+                acc -= (rho * cd * _kdrag[i] * speed) * vr;
+            }
+
+            //semi-implicit Euler
+            v += acc * h;
+            p += double3(v * h);
+
+            _px[i] = p.x; _py[i] = p.y; _pz[i] = p.z;
+            _vx[i] = v.x; _vy[i] = v.y; _vz[i] = v.z;
+        }
+    }
+
+    float wind_speed( float alt ) const
+    {
+        float f = glm::max(alt, 0.0f) / WIND_STEP;
+        uint i = uint(f);
+        if (i >= WIND_SAMPLES - 1)
+            return _wind[WIND_SAMPLES - 1];
+
+        f -= float(i);
+        return _wind[i] + (_wind[i+1] - _wind[i]) * f;
+    }
+
+    ///Swap-remove projectile
+    void remove( uint i )
+    {
+        if (_tracer[i] != UMAX32)
+            *_dead_tracers.add() = _tracer[i];
+
+        uint last = size() - 1;
+        if (i != last) {
+            _id[i] = _id[last];
+            _uservalue[i] = _uservalue[last];
+            _px[i] = _px[last]; _py[i] = _py[last]; _pz[i] = _pz[last];
+            _vx[i] = _vx[last]; _vy[i] = _vy[last]; _vz[i] = _vz[last];
+            _kdrag[i] = _kdrag[last];
+            _model[i] = _model[last];
+            _age[i] = _age[last];
+            _timeout[i] = _timeout[last];
+            _tracer[i] = _tracer[last];
+            _tracer_size[i] = _tracer_size[last];
+            _tracer_color[i] = _tracer_color[last];
+            _sync[i] = _sync[last];
+            _from[i] = _from[last];
+            _vfrom[i] = _vfrom[last];
+            _t[i] = _t[last];
+            _hpos[i] = _hpos[last];
+            _hnorm[i] = _hnorm[last];
+        }
+
+        _id.resize(last); _uservalue.resize(last);
+        _px.resize(last); _py.resize(last); _pz.resize(last);
+        _vx.resize(last); _vy.resize(last); _vz.resize(last);
+        _kdrag.resize(last); _model.resize(last);
+        _age.resize(last); _timeout.resize(last);
+        _tracer.resize(last); _sync.resize(last);
+        _tracer_size.resize(last); _tracer_color.resize(last);
+    }
+
+private:
+
+    iref<explosions> _exp;
+    params _params;
+    ballistic_ray_query* _rq = 0;
+
+    //projectile store
+    coid::dynarray<uint> _id;
+    coid::dynarray<uint> _uservalue;
+    coid::dynarray<double> _px, _py, _pz;
+    coid::dynarray<float> _vx, _vy, _vz;
+    coid::dynarray<float> _kdrag;           //< 0.5 * A * i / m
+    coid::dynarray<uint8> _model;           //< drag_model
+    coid::dynarray<float> _age;
+    coid::dynarray<float> _timeout;
+    coid::dynarray<uint> _tracer;           //< visual tracer id
+    coid::dynarray<float> _sync;            //< time to the next visual resync
+    coid::dynarray<float> _tracer_size;
+    coid::dynarray<float3> _tracer_color;
+
+    //step buffers
+    coid::dynarray<double3> _from, _to, _hpos;
+    coid::dynarray<float3> _hnorm;
+    coid::dynarray<float3> _vfrom;          //< velocities at the start of the last advance()
+    coid::dynarray<float> _t;
+
+    coid::dynarray<projectile_hit> _hits;
+    coid::dynarray<uint> _dead_tracers;
+
+    float _wind[WIND_SAMPLES] = {};
+    float2 _wind_dir = float2(0);
+
+    uint _next_id = 0;
+    bool _pending = false;                  //< advanced, waiting for resolve()
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///Runs ballistics::step on a dedicated thread, overlapping with the frame
+//@note kick() after the main thread work on the store is done, wait() before touching it again
+class ballistics_worker
+{
+public:
+
+    explicit ballistics_worker( ballistics& b )
+        : _b(b)
+        , _thread([this]() { run(); })
+    {}
+
+    ~ballistics_worker() {
+        {
+            std::lock_guard<std::mutex> lock(_mx);
+            _quit = true;
+        }
+        _cv.notify_all();
+        _thread.join();
+    }
+
+    ///Start integration of given time step
+    void kick( float dt ) {
+        {
+            std::lock_guard<std::mutex> lock(_mx);
+            DASSERT(!_pending);
+            _dt = dt;
+            _pending = true;
+        }
+        _cv.notify_all();
+    }
+
+    ///Wait for the running step to finish, call from the main thread
+    //@note resolves the hits here if the ray query is not thread safe
+    void wait() {
+        {
+            std::unique_lock<std::mutex> lock(_mx);
+            _cv.wait(lock, [this]() { return !_pending; });
+        }
+        _b.resolve();
+    }
+
+private:
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(_mx);
+        for (;;) {
+            _cv.wait(lock, [this]() { return _pending || _quit; });
+            if (_quit)
+                break;
+
+            float dt = _dt;
+            lock.unlock();
+            _b.advance(dt);
+            if (_b.ray_query_thread_safe())
+                _b.resolve();
+            lock.lock();
+
+            _pending = false;
+            _cv.notify_all();
+        }
+    }
+
+    ballistics& _b;
+
+    std::mutex _mx;
+    std::condition_variable _cv;
+    float _dt = 0;
+    bool _pending = false;
+    bool _quit = false;
+
+    std::thread _thread;
+};
+
+} //namespace ot
+
+#endif //__OT_BALLISTICS_H__
@@ -0,0 +1,541 @@
+#pragma once
+#ifndef __OT_BLEND_SPACE_H__
+#define __OT_BLEND_SPACE_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+
+#include <algorithm>
+#include <cfloat>
+
+#include "animation.h"
+#include "animation_stack.h"
+#include "glm/glm_ext.h"
+
+/**
+    Plugin-side 2D blend space evaluator.
+
+    The nodes of the blend space (animation, position, time scale, as with
+    blend_tree::add_node) are Delaunay-triangulated once in build(). The
+    blend weights for a parameter point are the barycentric coordinates of
+    the point in its containing triangle, found by walking across triangle
+    neighbors from the triangle found in the previous frame, which is
+    usually the same one or adjacent. Points outside of the convex hull
+    (computed by glm::chain_hull_2D) are clamped to it.
+
+    blend_space_batch evaluates many characters at once, with the
+    parameters, cached triangles and resulting weights in SoA arrays, and
+    feeds the weights of each character into its animation_stack through
+    blend_animation. Nodes that lost their weight since the last frame are
+    blended out with zero weight.
+
+    Each character has its own clock, advanced by apply(dt). The node
+    animations are played with explicit time: the clock scaled by the time
+    scale of the node, wrapped to the animation duration and normalized to
+    0..1, so that e.g. a run node with time scale 1.2 loops faster than a
+    walk node blended with it.
+
+    Example:
+        ot::blend_space bs;
+        bs.add_node(idle, float2(0, 0));
+        bs.add_node(walk, float2(0, 1.5f));
+        bs.add_node(run, float2(0, 5));
+        bs.add_node(strafe_left, float2(-1.5f, 0));
+        bs.add_node(strafe_right, float2(1.5f, 0));
+        bs.build();
+
+        ot::blend_space_batch crowd(bs);
+        uint id = crowd.add(stack);
+
+        //each frame
+        crowd.param_x()[id] = lateral_speed;
+        crowd.param_y()[id] = forward_speed;
+        crowd.evaluate();
+        crowd.apply(dt);
+**/
+
+namespace ot {
+
+///Blend weights of up to three nodes
+struct blend_weights
+{
+    uint node[3] = { UMAX32, UMAX32, UMAX32 };
+    float weight[3] = { 0, 0, 0 };
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class blend_space
+{
+public:
+
+    ///Add node
+    //@param time_scale animation speed of the node
+    //@return node index
+    uint add_node( const iref<animation>& anim, const float2& pos, float time_scale = 1.0f )
+    {
+        node* n = _nodes.add();
+        n->anim = anim;
+        n->pos = pos;
+        n->time_scale = time_scale;
+        return uint(_nodes.size() - 1);
+    }
+
+    uint node_count() const { return uint(_nodes.size()); }
+    const iref<animation>& node_anim( uint i ) const { return _nodes[i].anim; }
+    const float2& node_pos( uint i ) const { return _nodes[i].pos; }
+    float node_time_scale( uint i ) const { return _nodes[i].time_scale; }
+
+    uint triangle_count() const { return uint(_tris.size()); }
+
+    ///Triangulate the nodes and compute the convex hull
+    void build()
+    {
+        _tris.reset();
+        _hull.reset();
+
+        const uint n = uint(_nodes.size());
+        if (n < 3)
+            return;
+
+        triangulate();
+        link();
+
+        //convex hull of the node positions, sorted by x and y
+        coid::dynarray<float2> sorted;
+        sorted.resize(n);
+        for (uint i = 0; i < n; ++i)
+            sorted[i] = _nodes[i].pos;
+        std::sort(sorted.ptr(), sorted.ptr() + n, [](const float2& a, const float2& b) {
+            return a.x < b.x || (a.x == b.x && a.y < b.y);
+        });
+
+        _hull.resize(n + 1);
+        int nh = glm::chain_hull_2D(sorted.ptr(), int(n), _hull.ptr());
+        //last point repeats the first
+        _hull.resize(nh > 1 ? nh - 1 : nh);
+    }
+
+    ///Evaluate blend weights
+    //@param p parameter point
+    //@param hint [in/out] triangle to start the walk from, updated to the containing triangle
+    void evaluate( float2 p, uint& hint, blend_weights& out ) const
+    {
+        out = blend_weights();
+
+        const uint n = uint(_nodes.size());
+        if (!n)
+            return;
+
+        if (_tris.size() == 0) {
+            evaluate_degenerate(p, out);
+            return;
+        }
+
+        p = clamp_to_hull(p);
+
+        uint t = hint < _tris.size() ? hint : 0;
+        float3 bc;
+
+        //walk towards the point, bounded by the triangle count
+        uint steps = uint(_tris.size());
+        for (;;)
+        {
+            bc = bary(t, p);
+
+            uint worst = 0;
+            if (bc[1] < bc[worst]) worst = 1;
+            if (bc[2] < bc[worst]) worst = 2;
+
+            if (bc[worst] >= -1e-5f)
+                break;
+
+            uint next = _tris[t].adj[worst];
+            if (next == UMAX32 || !steps--) {
+                //on the hull boundary or lost, search all
+                t = locate(p, bc);
+                break;
+            }
+            t = next;
+        }
+
+        hint = t;
+
+        float sum = 0;
+        for (uint k = 0; k < 3; ++k) {
+            bc[k] = glm::max(bc[k], 0.0f);
+            sum += bc[k];
+        }
+        float inv = sum > 0 ? 1.0f / sum : 0;
+
+        for (uint k = 0; k < 3; ++k) {
+            out.node[k] = _tris[t].v[k];
+            out.weight[k] = bc[k] * inv;
+        }
+    }
+
+private:
+
+    struct node
+    {
+        iref<animation> anim;
+        float2 pos;
+        float time_scale;
+    };
+
+    struct triangle
+    {
+        uint v[3];                      //< node indices, counter-clockwise
+        uint adj[3];                    //< neighbor across the edge opposite to v[k], or UMAX32
+        float2 cc;                      //< circumcircle center (build only)
+        float cr2;                      //< squared circumcircle radius (build only)
+    };
+
+    //@return barycentric coordinates of p in triangle t
+    float3 bary( uint t, const float2& p ) const
+    {
+        const triangle& tr = _tris[t];
+        const float2& a = _nodes[tr.v[0]].pos;
+        const float2& b = _nodes[tr.v[1]].pos;
+        const float2& c = _nodes[tr.v[2]].pos;
+
+        //returns u along c-a, v along b-a
+        float2 uv = glm::barycentric(a, b, c, p);
+        return float3(1.0f - uv.x - uv.y, uv.y, uv.x);
+    }
+
+    //@return triangle containing p, or the one closest to containing it
+    uint locate( const float2& p, float3& bc ) const
+    {
+        uint best = 0;
+        float bestmin = -FLT_MAX;
+        for (uint t = 0; t < _tris.size(); ++t) {
+            float3 b = bary(t, p);
+            float m = glm::min(b.x, glm::min(b.y, b.z));
+            if (m > bestmin) {
+                bestmin = m;
+                best = t;
+                bc = b;
+            }
+        }
+        return best;
+    }
+
+    float2 clamp_to_hull( const float2& p ) const
+    {
+        const uint nh = uint(_hull.size());
+        if (nh < 3)
+            return p;
+
+        //inside if left of all counter-clockwise edges
+        bool inside = true;
+        for (uint i = 0; i < nh && inside; ++i)
+            inside = glm::chain_hull_is_left(_hull[i], _hull[(i + 1) % nh], p) >= 0;
+        if (inside)
+            return p;
+
+        float2 best = p;
+        float bestd = FLT_MAX;
+        for (uint i = 0; i < nh; ++i) {
+            const float2& a = _hull[i];
+            const float2& b = _hull[(i + 1) % nh];
+            float2 ab = b - a;
+            float l2 = glm::dot(ab, ab);
+            float t = l2 > 0 ? glm::clamp(glm::dot(p - a, ab) / l2, 0.0f, 1.0f) : 0.0f;
+            float2 q = a + ab * t;
+            float d = glm::length_squared(p - q);
+            if (d < bestd) {
+                bestd = d;
+                best = q;
+            }
+        }
+        return best;
+    }
+
+    ///Fewer than 3 nodes or all collinear: blend the two nearest nodes
+    void evaluate_degenerate( const float2& p, blend_weights& out ) const
+    {
+        const uint n = uint(_nodes.size());
+        uint i0 = UMAX32, i1 = UMAX32;
+        float d0 = FLT_MAX, d1 = FLT_MAX;
+
+        for (uint i = 0; i < n; ++i) {
+            float d = glm::length(p - _nodes[i].pos);
+            if (d < d0) {
+                i1 = i0; d1 = d0;
+                i0 = i; d0 = d;
+            }
+            else if (d < d1) {
+                i1 = i; d1 = d;
+            }
+        }
+
+        out.node[0] = i0;
+        if (i1 == UMAX32 || d0 + d1 <= 0) {
+            out.weight[0] = 1;
+            return;
+        }
+
+        out.node[1] = i1;
+        out.weight[0] = d1 / (d0 + d1);
+        out.weight[1] = d0 / (d0 + d1);
+    }
+
+    ///Bowyer-Watson Delaunay triangulation
+    void triangulate()
+    {
+        const uint n = uint(_nodes.size());
+
+        //super triangle around all nodes, its vertices are appended as extra nodes
+        float2 lo(FLT_MAX), hi(-FLT_MAX);
+        for (uint i = 0; i < n; ++i) {
+            lo = glm::min(lo, _nodes[i].pos);
+            hi = glm::max(hi, _nodes[i].pos);
+        }
+        float2 c = 0.5f * (lo + hi);
+        float r = glm::max(hi.x - lo.x, hi.y - lo.y) * 10.0f + 1.0f;
+
+        _nodes.add(3);
+        _nodes[n].pos = c + float2(-r, -r);
+        _nodes[n + 1].pos = c + float2(r, -r);
+        _nodes[n + 2].pos = c + float2(0, r);
+        add_triangle(n, n + 1, n + 2);
+
+        struct edge { uint a, b; };
+        coid::dynarray<edge> poly;
+
+        for (uint i = 0; i < n; ++i)
+        {
+            const float2& p = _nodes[i].pos;
+            poly.reset();
+
+            //remove triangles whose circumcircle contains p, collecting their boundary
+            for (uint t = 0; t < _tris.size(); )
+            {
+                const triangle& tr = _tris[t];
+                if (glm::length_squared(p - tr.cc) > tr.cr2) {
+                    ++t;
+                    continue;
+                }
+
+                for (uint k = 0; k < 3; ++k) {
+                    edge e = { tr.v[k], tr.v[(k + 1) % 3] };
+                    //shared edges are interior, drop both
+                    bool shared = false;
+                    for (uint j = 0; j < poly.size(); ++j) {
+                        if (poly[j].a == e.b && poly[j].b == e.a) {
+                            poly[j] = poly.last();
+                            poly.resize(poly.size() - 1);
+                            shared = true;
+                            break;
+                        }
+                    }
+                    if (!shared)
+                        *poly.add() = e;
+                }
+
+                _tris[t] = _tris.last();
+                _tris.resize(_tris.size() - 1);
+            }
+
+            for (uint j = 0; j < poly.size(); ++j)
+                add_triangle(poly[j].a, poly[j].b, i);
+        }
+
+        //drop triangles using the super triangle vertices
+        for (uint t = 0; t < _tris.size(); ) {
+            const triangle& tr = _tris[t];
+            if (tr.v[0] >= n || tr.v[1] >= n || tr.v[2] >= n) {
+                _tris[t] = _tris.last();
+                _tris.resize(_tris.size() - 1);
+            }
+            else
+                ++t;
+        }
+
+        _nodes.resize(n);
+    }
+
+    void add_triangle( uint a, uint b, uint c )
+    {
+        const float2& pa = _nodes[a].pos;
+        const float2& pb = _nodes[b].pos;
+        const float2& pc = _nodes[c].pos;
+
+        //degenerate (collinear) triangles are skipped
+        float area = glm::chain_hull_is_left(pa, pb, pc);
+        if (fabsf(area) < 1e-12f)
+            return;
+
+        triangle* t = _tris.add();
+        if (area > 0) {
+            t->v[0] = a; t->v[1] = b; t->v[2] = c;
+        }
+        else {
+            t->v[0] = a; t->v[1] = c; t->v[2] = b;
+        }
+
+        float d = 2.0f * (pa.x * (pb.y - pc.y) + pb.x * (pc.y - pa.y) + pc.x * (pa.y - pb.y));
+        float a2 = glm::dot(pa, pa), b2 = glm::dot(pb, pb), c2 = glm::dot(pc, pc);
+        t->cc = float2(
+            (a2 * (pb.y - pc.y) + b2 * (pc.y - pa.y) + c2 * (pa.y - pb.y)) / d,
+            (a2 * (pc.x - pb.x) + b2 * (pa.x - pc.x) + c2 * (pb.x - pa.x)) / d);
+        t->cr2 = glm::length_squared(pa - t->cc);
+    }
+
+    ///Find triangle neighbors
+    void link()
+    {
+        const uint nt = uint(_tris.size());
+        for (uint t = 0; t < nt; ++t)
+            _tris[t].adj[0] = _tris[t].adj[1] = _tris[t].adj[2] = UMAX32;
+
+        for (uint t = 0; t < nt; ++t) {
+            for (uint k = 0; k < 3; ++k) {
+                //edge opposite to v[k]
+                uint a = _tris[t].v[(k + 1) % 3];
+                uint b = _tris[t].v[(k + 2) % 3];
+
+                for (uint u = 0; u < nt && _tris[t].adj[k] == UMAX32; ++u) {
+                    if (u == t)
+                        continue;
+                    for (uint j = 0; j < 3; ++j) {
+                        if (_tris[u].v[(j + 1) % 3] == b && _tris[u].v[(j + 2) % 3] == a) {
+                            _tris[t].adj[k] = u;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+private:
+
+    coid::dynarray<node> _nodes;
+    coid::dynarray<triangle> _tris;
+    coid::dynarray<float2> _hull;       //< convex hull, counter-clockwise
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///Blend space evaluation for many characters, SoA
+class blend_space_batch
+{
+public:
+
+    explicit blend_space_batch( const blend_space& bs )
+        : _bs(bs)
+    {}
+
+    ///Add character
+    //@return character index
+    uint add( const iref<animation_stack>& stack )
+    {
+        uint id = uint(_stack.size());
+        *_stack.add() = stack;
+        *_x.add() = 0;
+        *_y.add() = 0;
+        *_hint.add() = 0;
+        *_w.add() = blend_weights();
+        *_prev.add() = blend_weights();
+        *_time.add() = 0;
+        return id;
+    }
+
+    uint size() const { return uint(_stack.size()); }
+
+    //@{ SoA parameters
+    float* param_x() { return _x.ptr(); }
+    float* param_y() { return _y.ptr(); }
+    //@}
+
+    ///Per-character clocks [s], can be set to desynchronize the characters
+    float* time() { return _time.ptr(); }
+
+    const blend_weights* weights() const { return _w.ptr(); }
+
+    ///Evaluate weights of all characters
+    void evaluate()
+    {
+        const uint n = size();
+        const float* x = _x.ptr();
+        const float* y = _y.ptr();
+        uint* hint = _hint.ptr();
+        blend_weights* w = _w.ptr();
+
+        for (uint i = 0; i < n; ++i)
+            _bs.evaluate(float2(x[i], y[i]), hint[i], w[i]);
+    }
+
+    ///Advance the character clocks and feed the weights and node times into the animation stacks
+    //@param dt time step [s]
+    void apply( float dt )
+    {
+        //node durations, 0 for animations not loaded yet
+        const uint nn = _bs.node_count();
+        _duration.resize(nn);
+        for (uint k = 0; k < nn; ++k) {
+            const animation* a = _bs.node_anim(k).get();
+            uint nf = a && a->is_ready() ? a->get_frame_count() : 0;
+            uint fps = nf > 1 ? a->get_fps() : 0;
+            _duration[k] = fps ? (nf - 1) / float(fps) : 0;
+        }
+
+        const uint n = size();
+        for (uint i = 0; i < n; ++i)
+        {
+            _time[i] += dt;
+
+            animation_stack* st = _stack[i].get();
+            if (!st)
+                continue;
+
+            const blend_weights& w = _w[i];
+            const blend_weights& p = _prev[i];
+
+            //blend out nodes that are no longer used
+            for (uint k = 0; k < 3; ++k) {
+                uint pn = p.node[k];
+                if (pn == UMAX32 || pn == w.node[0] || pn == w.node[1] || pn == w.node[2])
+                    continue;
+                st->blend_animation(_bs.node_anim(pn), 0.0f);
+            }
+
+            for (uint k = 0; k < 3; ++k) {
+                uint nk = w.node[k];
+                if (nk == UMAX32)
+                    continue;
+
+                float t = _time[i] * _bs.node_time_scale(nk);
+                float d = _duration[nk];
+                if (d > 0)
+                    t -= d * floorf(t / d);
+
+                //explicit time is normalized 0..1, like add_animation/set_animation_time
+                st->blend_animation(_bs.node_anim(nk), w.weight[k], true, d > 0 ? t / d : 0.0f);
+            }
+
+            _prev[i] = w;
+        }
+    }
+
+private:
+
+    const blend_space& _bs;
+
+    coid::dynarray<iref<animation_stack>> _stack;
+    coid::dynarray<float> _x;
+    coid::dynarray<float> _y;
+    coid::dynarray<uint> _hint;         //< last containing triangle
+    coid::dynarray<blend_weights> _w;
+    coid::dynarray<blend_weights> _prev;
+    coid::dynarray<float> _time;        //< character clock [s]
+
+    coid::dynarray<float> _duration;    //< node animation durations [s] (apply only)
+};
+
+} //namespace ot
+
+#endif //__OT_BLEND_SPACE_H__
@@ -0,0 +1,366 @@
+#pragma once
+#ifndef __OT_CANVAS_CMD_H__
+#define __OT_CANVAS_CMD_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+#include <comm/token.h>
+
+#include "canvas.h"
+
+/**
+    Command buffer recorder for ot::canvas.
+
+    Drawing calls are recorded into a compact array of POD commands, text is
+    copied into a shared character arena. The buffer is replayed to a canvas
+    with a single submit() call, which also drops redundant state changes
+    (repeated line params, clips and colors, identity transforms, empty
+    push/pop pairs) so that only the calls that change the output reach the
+    host.
+
+    Static parts of a page can be recorded once into a canvas_layer and
+    resubmitted every frame, only the dynamic layer is re-recorded. Buffers
+    can be appended into each other, so a page can be composed from cached
+    layers into a single buffer.
+
+    Example:
+        ot::canvas_layer background;
+        ot::canvas_cmdbuf dyn;
+
+        if (background.dirty()) {
+            ot::canvas_cmdbuf& cb = background.record();
+            cb.fill_rect(0, 0, 512, 512, u8vec4(0x20, 0x20, 0x20, 0xff));
+            ...
+        }
+
+        dyn.reset();
+        dyn.translate(256, 256);
+        dyn.rotate(heading);
+        dyn.draw_image(needle, -4, -100, u8vec4(0xff));
+
+        background.buffer().submit(*cnv);
+        dyn.submit(*cnv);
+**/
+
+namespace ot {
+
+////////////////////////////////////////////////////////////////////////////////
+class canvas_cmdbuf
+{
+public:
+
+    enum EOp : uint8 {
+        OP_IDENTITY,
+        OP_TRANSLATE,
+        OP_ROTATE,
+        OP_SCALE,
+        OP_CLIP,
+        OP_LINE_PARAMS,
+        OP_PUSH,
+        OP_POP,
+        OP_COLOR,
+        OP_RECT,
+        OP_LINE,
+        OP_IMAGE,
+        OP_IMAGE_WH,
+        OP_TEXT,
+        OP_TEXT2,
+        OP_TEXT_WH,
+        OP_TEXT_FT,
+    };
+
+    ///Recorded command
+    struct command
+    {
+        EOp op;
+        uint8 pad[3];
+        u8vec4 color;
+        u8vec4 color2;                  //< back color of OP_TEXT_WH
+        uint arg;                       //< font, image, anchor, pixel height or global color
+        uint text;                      //< offset of the text in the arena
+        uint16 textlen;                 //< text length
+        uint16 fontlen;                 //< font name length preceding the text (OP_TEXT_FT)
+        float f[4];                     //< coordinates
+    };
+
+    //@{ Transformations and state, see ot::canvas
+    void load_identity()                        { add(OP_IDENTITY); }
+    void translate( float x, float y )          { add(OP_TRANSLATE, x, y); }
+    void rotate( float angle )                  { add(OP_ROTATE, angle); }
+    void scale( float x, float y )              { add(OP_SCALE, x, y); }
+    void set_clipping_rect( float x, float y, float w, float h ) { add(OP_CLIP, x, y, w, h); }
+    void set_line_params( float width, float smooth_size )      { add(OP_LINE_PARAMS, width, smooth_size); }
+    void push_state()                           { add(OP_PUSH); }
+    void pop_state()                            { add(OP_POP); }
+    void set_color( uint col )                  { add(OP_COLOR)->arg = col; }
+    //@}
+
+    //@{ Primitives, see ot::canvas
+    void fill_rect( float x, float y, float w, float h, const u8vec4& color ) {
+        add(OP_RECT, x, y, w, h)->color = color;
+    }
+
+    void draw_line( float x, float y, float x2, float y2, const u8vec4& color ) {
+        add(OP_LINE, x, y, x2, y2)->color = color;
+    }
+
+    void draw_image( uint image, float x, float y, const u8vec4& color ) {
+        command* c = add(OP_IMAGE, x, y);
+        c->arg = image;
+        c->color = color;
+    }
+
+    void draw_image_wh( uint image, float x, float y, float w, float h, const u8vec4& color ) {
+        command* c = add(OP_IMAGE_WH, x, y, w, h);
+        c->arg = image;
+        c->color = color;
+    }
+
+    void draw_text( uint font, float x, float y, const coid::token& text, const u8vec4& color ) {
+        command* c = add_text(OP_TEXT, coid::token(), text, x, y);
+        c->arg = font;
+        c->color = color;
+    }
+
+    void draw_text2( uint font, float x, float y, const coid::token& text, const u8vec4& color ) {
+        command* c = add_text(OP_TEXT2, coid::token(), text, x, y);
+        c->arg = font;
+        c->color = color;
+    }
+
+    void draw_text_wh( uint font, float x, float y, float w, float h, uint anchor, const coid::token& text, const u8vec4& color, const u8vec4& backcolor ) {
+        command* c = add_text(OP_TEXT_WH, coid::token(), text, x, y, w, h);
+        c->arg = font | (anchor << 24);
+        c->color = color;
+        c->color2 = backcolor;
+    }
+
+    void draw_text_ft( const coid::token& font, uint pixel_height, float x, float y, const coid::token& text, const u8vec4& color ) {
+        command* c = add_text(OP_TEXT_FT, font, text, x, y);
+        c->arg = pixel_height;
+        c->color = color;
+    }
+    //@}
+
+    ///Append another buffer (or this one), enclosed in push/pop so that its state does not leak
+    void append( const canvas_cmdbuf& cb )
+    {
+        //sizes taken before growing, source pointers after, so that appending
+        // the buffer to itself copies the original commands
+        const uint ncmds = uint(cb._cmds.size());
+        const uint ntext = uint(cb._text.size());
+        if (!ncmds)
+            return;
+
+        uint base = uint(_text.size());
+        uint n = uint(_cmds.size());
+
+        push_state();
+        _cmds.add(ncmds);
+        ::memcpy(_cmds.ptr() + n + 1, cb._cmds.ptr(), ncmds * sizeof(command));
+        pop_state();
+
+        if (ntext) {
+            _text.add(ntext);
+            ::memcpy(_text.ptr() + base, cb._text.ptr(), ntext);
+
+            command* c = _cmds.ptr() + n + 1;
+            command* ce = c + ncmds;
+            for (; c < ce; ++c)
+                if (c->op >= OP_TEXT)
+                    c->text += base;
+        }
+    }
+
+    ///Replay the buffer to canvas
+    //@return number of canvas calls made
+    uint submit( canvas& cnv ) const
+    {
+        //current state for dropping redundant state calls, reset to unknown on pop
+        float lw = -1, ls = -1;
+        float clip[4] = { -1, -1, -1, -1 };
+        uint color = UMAX32;
+
+        uint ncalls = 0;
+        const command* c = _cmds.ptr();
+        const command* ce = c + _cmds.size();
+
+        for (; c < ce; ++c)
+        {
+            switch (c->op) {
+            case OP_IDENTITY:
+                cnv.load_identity();
+                break;
+            case OP_TRANSLATE:
+                if (c->f[0] == 0 && c->f[1] == 0)
+                    continue;
+                cnv.translate(c->f[0], c->f[1]);
+                break;
+            case OP_ROTATE:
+                if (c->f[0] == 0)
+                    continue;
+                cnv.rotate(c->f[0]);
+                break;
+            case OP_SCALE:
+                if (c->f[0] == 1 && c->f[1] == 1)
+                    continue;
+                cnv.scale(c->f[0], c->f[1]);
+                break;
+            case OP_CLIP:
+                if (::memcmp(clip, c->f, sizeof(clip)) == 0)
+                    continue;
+                ::memcpy(clip, c->f, sizeof(clip));
+                cnv.set_clipping_rect(c->f[0], c->f[1], c->f[2], c->f[3]);
+                break;
+            case OP_LINE_PARAMS:
+                if (lw == c->f[0] && ls == c->f[1])
+                    continue;
+                lw = c->f[0];
+                ls = c->f[1];
+                cnv.set_line_params(lw, ls);
+                break;
+            case OP_PUSH:
+                //skip push/pop pairs with nothing in between
+                if (c + 1 < ce && c[1].op == OP_POP) {
+                    ++c;
+                    continue;
+                }
+                cnv.push_state();
+                break;
+            case OP_POP:
+                cnv.pop_state();
+                lw = ls = -1;
+                clip[0] = clip[1] = clip[2] = clip[3] = -1;
+                break;
+            case OP_COLOR:
+                if (color == c->arg)
+                    continue;
+                color = c->arg;
+                cnv.set_color(color);
+                break;
+            case OP_RECT:
+                cnv.fill_rect(c->f[0], c->f[1], c->f[2], c->f[3], c->color);
+                break;
+            case OP_LINE:
+                cnv.draw_line(c->f[0], c->f[1], c->f[2], c->f[3], c->color);
+                break;
+            case OP_IMAGE:
+                cnv.draw_image(c->arg, c->f[0], c->f[1], c->color);
+                break;
+            case OP_IMAGE_WH:
+                cnv.draw_image_wh(c->arg, c->f[0], c->f[1], c->f[2], c->f[3], c->color);
+                break;
+            case OP_TEXT:
+                cnv.draw_text(c->arg, c->f[0], c->f[1], text(c), c->color);
+                break;
+            case OP_TEXT2:
+                cnv.draw_text2(c->arg, c->f[0], c->f[1], text(c), c->color);
+                break;
+            case OP_TEXT_WH:
+                cnv.draw_text_wh(c->arg & 0xffffffU, c->f[0], c->f[1], c->f[2], c->f[3], c->arg >> 24,
+                    text(c), c->color, c->color2);
+                break;
+            case OP_TEXT_FT:
+                cnv.draw_text_ft(font(c), c->arg, c->f[0], c->f[1], text(c), c->color);
+                break;
+            }
+
+            ++ncalls;
+        }
+
+        return ncalls;
+    }
+
+    ///Clear the buffer, keeping the allocated memory
+    void reset() {
+        _cmds.reset();
+        _text.reset();
+    }
+
+    //@return number of recorded commands
+    uint size() const { return uint(_cmds.size()); }
+
+    const command* commands() const { return _cmds.ptr(); }
+
+    //@return text of a text command
+    coid::token text( const command* c ) const {
+        const char* p = _text.ptr() + c->text + c->fontlen;
+        return coid::token(p, p + c->textlen);
+    }
+
+    //@return font name of OP_TEXT_FT command
+    coid::token font( const command* c ) const {
+        const char* p = _text.ptr() + c->text;
+        return coid::token(p, p + c->fontlen);
+    }
+
+private:
+
+    command* add( EOp op, float a = 0, float b = 0, float c = 0, float d = 0 )
+    {
+        command* cmd = _cmds.add();
+        ::memset(cmd, 0, sizeof(command));
+        cmd->op = op;
+        cmd->f[0] = a;
+        cmd->f[1] = b;
+        cmd->f[2] = c;
+        cmd->f[3] = d;
+        return cmd;
+    }
+
+    command* add_text( EOp op, const coid::token& font, const coid::token& text, float a, float b, float c = 0, float d = 0 )
+    {
+        DASSERT(font.len() <= 0xffffU && text.len() <= 0xffffU);
+
+        command* cmd = add(op, a, b, c, d);
+        cmd->text = uint(_text.size());
+        cmd->fontlen = uint16(font.len());
+        cmd->textlen = uint16(text.len());
+
+        char* p = _text.add(font.len() + text.len());
+        ::memcpy(p, font.ptr(), font.len());
+        ::memcpy(p + font.len(), text.ptr(), text.len());
+        return cmd;
+    }
+
+private:
+
+    coid::dynarray<command> _cmds;
+    coid::dynarray<char> _text;         //< text arena
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///Cached command buffer, re-recorded only when invalidated
+class canvas_layer
+{
+public:
+
+    //@return true if the layer has to be recorded
+    bool dirty() const { return _dirty; }
+
+    ///Mark the layer for re-recording
+    void invalidate() { _dirty = true; }
+
+    ///Start recording, clears the buffer and the dirty flag
+    canvas_cmdbuf& record() {
+        _buf.reset();
+        _dirty = false;
+        return _buf;
+    }
+
+    const canvas_cmdbuf& buffer() const { return _buf; }
+
+    uint submit( canvas& cnv ) const { return _buf.submit(cnv); }
+
+private:
+
+    canvas_cmdbuf _buf;
+    bool _dirty = true;
+};
+
+} //namespace ot
+
+#endif //__OT_CANVAS_CMD_H__
@@ -0,0 +1,541 @@
+#pragma once
+#ifndef __OT_CANVAS_PATH_H__
+#define __OT_CANVAS_PATH_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+
+#include <immintrin.h>
+#include <algorithm>
+
+#include "canvas_cmd.h"
+#include "glm/glm_ext.h"
+
+/**
+    Path primitives for canvas: polylines, arcs, ring sectors and filled
+    polygons.
+
+    Paths are flattened into SoA point arrays, arcs are generated four
+    points at a time with SSE sincos. The flattened path is tessellated into
+    canvas primitives that the host can draw:
+        - strokes become a run of draw_line segments sharing one
+          set_line_params, with the segment ends extended to close miter
+          joins and square caps; bevel joins add one short line per vertex
+          covering the bevel triangle
+        - fills are scan converted (even-odd rule) into fill_rect spans,
+          spans whose edges stay within the fill tolerance on consecutive
+          rows are merged into taller rects. The canvas has no polygon
+          primitive, so slanted edges still cost about one rect per row
+          and per edge wherever they move by more than the tolerance
+
+    Tessellation results are cached in the path and only rebuilt when the
+    path or the stroke/fill parameters change, so unchanged gauge scales
+    cost only the emission into the command buffer. Coordinates are local,
+    the shapes follow the canvas transform stack (translate/rotate/scale,
+    push_state/pop_state) like any other primitive.
+
+    Example:
+        ot::canvas_path scale;
+        scale.ring_sector(0, 0, 90, 100, -2.4f, 2.4f);
+
+        ot::canvas_path needle;
+        needle.move_to(0, 0);
+        needle.line_to(0, -80);
+
+        scale.fill(cmdbuf, u8vec4(0x40, 0x40, 0x40, 0xff));
+        cmdbuf.push_state();
+        cmdbuf.rotate(angle);
+        needle.stroke(cmdbuf, 3.0f, 1.0f, u8vec4(0xff));
+        cmdbuf.pop_state();
+**/
+
+namespace ot {
+
+////////////////////////////////////////////////////////////////////////////////
+class canvas_path
+{
+public:
+
+    enum EJoin : uint8 {
+        JOIN_BEVEL,                     //< segments end at the vertex, outer corner cut straight
+        JOIN_MITER,                     //< segments extended to cover the outer corner, up to the miter limit
+    };
+
+    enum ECap : uint8 {
+        CAP_BUTT,                       //< line ends at the end point
+        CAP_SQUARE,                     //< line extended by half width
+    };
+
+    //@param tolerance max distance of flattened arcs from the true curve
+    explicit canvas_path( float tolerance = 0.25f )
+        : _tolerance(tolerance)
+    {}
+
+    ///Clear the path
+    void reset() {
+        _x.reset();
+        _y.reset();
+        _sub.reset();
+        invalidate();
+    }
+
+    ///Start a new subpath
+    void move_to( float x, float y ) {
+        subpath* s = _sub.add();
+        s->first = uint(_x.size());
+        s->count = 0;
+        s->closed = false;
+        add_point(x, y);
+    }
+
+    ///Add line to the current subpath
+    //@note after close() a new subpath is started at the start of the closed one
+    void line_to( float x, float y ) {
+        if (!_sub.size())
+            move_to(x, y);
+        else {
+            reopen();
+            add_point(x, y);
+        }
+    }
+
+    ///Add circular arc to the current subpath, connected by a line from the current point
+    //@param a0 start angle [rad], measured from the +x axis towards +y
+    //@param a1 end angle [rad]
+    //@note after close() a new subpath is started at the start of the closed one
+    void arc( float cx, float cy, float r, float a0, float a1 )
+    {
+        uint n = arc_segments(r, a1 - a0);
+        if (!_sub.size())
+            move_to(cx + r * cosf(a0), cy + r * sinf(a0));
+        else
+            reopen();
+
+        uint base = uint(_x.size());
+        _x.add(n + 1);
+        _y.add(n + 1);
+        _sub.last().count += n + 1;
+
+        gen_arc(_x.ptr() + base, _y.ptr() + base, cx, cy, r, a0, (a1 - a0) / n, n + 1);
+
+        //drop the first arc point if it coincides with the current point
+        if (base > _sub.last().first && same_point(base - 1, base)) {
+            ::memmove(_x.ptr() + base, _x.ptr() + base + 1, n * sizeof(float));
+            ::memmove(_y.ptr() + base, _y.ptr() + base + 1, n * sizeof(float));
+            _x.resize(base + n);
+            _y.resize(base + n);
+            --_sub.last().count;
+        }
+        invalidate();
+    }
+
+    ///Close the current subpath
+    void close()
+    {
+        if (!_sub.size())
+            return;
+
+        //the closing segment is implicit, drop a duplicate end point
+        subpath& s = _sub.last();
+        uint last = s.first + s.count - 1;
+        if (s.count > 2 && same_point(s.first, last)) {
+            _x.resize(last);
+            _y.resize(last);
+            --s.count;
+        }
+
+        s.closed = true;
+        invalidate();
+    }
+
+    ///Add polyline as a new subpath
+    void polyline( const float2* pts, uint n, bool closed = false )
+    {
+        if (!n)
+            return;
+        move_to(pts[0].x, pts[0].y);
+        for (uint i = 1; i < n; ++i)
+            add_point(pts[i].x, pts[i].y);
+        if (closed)
+            close();
+    }
+
+    ///Add full circle as a closed subpath
+    void circle( float cx, float cy, float r ) {
+        move_to(cx + r, cy);
+        arc(cx, cy, r, 0, float(2 * M_PI));
+        close();
+    }
+
+    ///Add ring sector (annulus segment) as a closed subpath
+    //@param r0 inner radius
+    //@param r1 outer radius
+    void ring_sector( float cx, float cy, float r0, float r1, float a0, float a1 )
+    {
+        move_to(cx + r1 * cosf(a0), cy + r1 * sinf(a0));
+        arc(cx, cy, r1, a0, a1);
+        arc(cx, cy, r0, a1, a0);
+        close();
+    }
+
+    ///Emit the path as stroked lines
+    //@param width line width
+    //@param smooth line edge smoothing, see canvas::set_line_params
+    void stroke( canvas_cmdbuf& cb, float width, float smooth, const u8vec4& color,
+        EJoin join = JOIN_MITER, ECap cap = CAP_BUTT, float miter_limit = 4.0f )
+    {
+        if (!_stroke_valid || _width != width || _join != join || _cap != cap || _miter_limit != miter_limit) {
+            _width = width;
+            _join = join;
+            _cap = cap;
+            _miter_limit = miter_limit;
+            build_stroke();
+            _stroke_valid = true;
+        }
+
+        if (!_segs.size())
+            return;
+
+        cb.set_line_params(width, smooth);
+        const float4* s = _segs.ptr();
+        const float4* se = s + _segs.size();
+        for (; s < se; ++s)
+            cb.draw_line(s->x, s->y, s->z, s->w, color);
+
+        //bevel triangles, each a line as wide as the bevel
+        for (uint i = 0; i < _bevels.size(); ++i) {
+            const float4& b = _bevels[i];
+            cb.set_line_params(_bevel_width[i], smooth);
+            cb.draw_line(b.x, b.y, b.z, b.w, color);
+        }
+        if (_bevels.size())
+            cb.set_line_params(width, smooth);
+    }
+
+    ///Emit the path as filled area (even-odd rule)
+    //@param row scan row height, 1 pixel for unscaled canvas
+    //@param tolerance max deviation of span edges merged into one taller rect
+    void fill( canvas_cmdbuf& cb, const u8vec4& color, float row = 1.0f, float tolerance = 0.5f )
+    {
+        if (!_fill_valid || _row != row || _fill_tolerance != tolerance) {
+            _row = row;
+            _fill_tolerance = tolerance;
+            build_fill();
+            _fill_valid = true;
+        }
+
+        const float4* s = _spans.ptr();
+        const float4* se = s + _spans.size();
+        for (; s < se; ++s)
+            cb.fill_rect(s->x, s->y, s->z, s->w, color);
+    }
+
+    //@return number of points in the flattened path
+    uint size() const { return uint(_x.size()); }
+
+    //@return cached stroke segments (x0, y0, x1, y1)
+    const coid::dynarray<float4>& stroke_segments() const { return _segs; }
+
+    //@return cached fill spans (x, y, w, h)
+    const coid::dynarray<float4>& fill_spans() const { return _spans; }
+
+private:
+
+    struct subpath
+    {
+        uint first;
+        uint count;
+        bool closed;
+    };
+
+    void invalidate() {
+        _stroke_valid = false;
+        _fill_valid = false;
+    }
+
+    bool same_point( uint a, uint b ) const {
+        return fabsf(_x[a] - _x[b]) < 1e-4f && fabsf(_y[a] - _y[b]) < 1e-4f;
+    }
+
+    ///Start a new subpath at the start of the last one if it was closed
+    void reopen() {
+        const subpath& s = _sub.last();
+        if (s.closed)
+            move_to(_x[s.first], _y[s.first]);
+    }
+
+    void add_point( float x, float y ) {
+        *_x.add() = x;
+        *_y.add() = y;
+        ++_sub.last().count;
+        invalidate();
+    }
+
+    //@return number of segments for an arc within the tolerance
+    uint arc_segments( float r, float angle ) const
+    {
+        r = fabsf(r);
+        angle = fabsf(angle);
+        if (r <= _tolerance)
+            return 1;
+
+        //max angle per segment so that the sagitta stays within tolerance
+        float step = 2.0f * acosf(1.0f - _tolerance / r);
+        uint n = uint(ceilf(angle / step));
+        return n < 1 ? 1 : (n > 1024 ? 1024 : n);
+    }
+
+    ///Generate arc points, 4 at a time
+    static void gen_arc( float* x, float* y, float cx, float cy, float r, float a0, float da, uint n )
+    {
+        const __m128 vcx = _mm_set1_ps(cx);
+        const __m128 vcy = _mm_set1_ps(cy);
+        const __m128 vr = _mm_set1_ps(r);
+        const __m128 vda4 = _mm_set1_ps(4 * da);
+        __m128 va = _mm_setr_ps(a0, a0 + da, a0 + 2*da, a0 + 3*da);
+
+        uint i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128 c;
+            __m128 s = glm::_mm_sincos_ps(&c, va);
+            _mm_storeu_ps(x + i, _mm_add_ps(vcx, _mm_mul_ps(vr, c)));
+            _mm_storeu_ps(y + i, _mm_add_ps(vcy, _mm_mul_ps(vr, s)));
+            va = _mm_add_ps(va, vda4);
+        }
+
+        for (; i < n; ++i) {
+            float a = a0 + da * i;
+            x[i] = cx + r * cosf(a);
+            y[i] = cy + r * sinf(a);
+        }
+    }
+
+    ///Tessellate subpaths into line segments with join and cap extensions
+    void build_stroke()
+    {
+        _segs.reset();
+        _bevels.reset();
+        _bevel_width.reset();
+
+        const float hw = 0.5f * _width;
+        const float maxext = _join == JOIN_MITER ? _miter_limit * hw : 0.0f;
+        const float capext = _cap == CAP_SQUARE ? hw : 0.0f;
+
+        for (uint si = 0; si < _sub.size(); ++si)
+        {
+            const subpath& sp = _sub[si];
+            uint np = sp.count;
+            if (np < 2)
+                continue;
+
+            uint nseg = sp.closed ? np : np - 1;
+            segment_dirs(_x.ptr() + sp.first, _y.ptr() + sp.first, np, sp.closed);
+
+            //extension at the start of each segment, ext[nseg] is the end of the last one
+            _ext.resize(nseg + 1);
+            for (uint i = 1; i < nseg; ++i)
+                _ext[i] = join_ext(i - 1, i, hw, maxext);
+
+            if (sp.closed)
+                _ext[0] = _ext[nseg] = join_ext(nseg - 1, 0, hw, maxext);
+            else
+                _ext[0] = _ext[nseg] = capext;
+
+            const float* px = _x.ptr() + sp.first;
+            const float* py = _y.ptr() + sp.first;
+
+            for (uint i = 0; i < nseg; ++i)
+            {
+                if (_len[i] <= 0)
+                    continue;
+
+                uint j = i + 1 < np ? i + 1 : 0;
+                float e0 = _ext[i];
+                float e1 = _ext[i + 1];
+
+                *_segs.add() = float4(
+                    px[i] - _ux[i] * e0, py[i] - _uy[i] * e0,
+                    px[j] + _ux[i] * e1, py[j] + _uy[i] * e1);
+            }
+
+            if (_join == JOIN_BEVEL) {
+                for (uint i = 1; i < nseg; ++i)
+                    add_bevel(i - 1, i, px[i], py[i], hw);
+                if (sp.closed)
+                    add_bevel(nseg - 1, 0, px[0], py[0], hw);
+            }
+        }
+    }
+
+    ///Add line covering the bevel triangle between the outer corners of segments meeting at vertex
+    void add_bevel( uint a, uint b, float vx, float vy, float hw )
+    {
+        if (_len[a] <= 0 || _len[b] <= 0)
+            return;
+
+        //outer side is on the right of a left turn
+        float cross = _ux[a] * _uy[b] - _uy[a] * _ux[b];
+        float side = cross > 0 ? hw : -hw;
+        float2 na(_uy[a] * side, -_ux[a] * side);
+        float2 nb(_uy[b] * side, -_ux[b] * side);
+
+        //line from the vertex to the middle of the bevel edge, as wide as the edge
+        float w = glm::length(na - nb);
+        if (w < 1e-3f)
+            return;
+
+        float2 m = 0.5f * (na + nb);
+        *_bevels.add() = float4(vx, vy, vx + m.x, vy + m.y);
+        *_bevel_width.add() = w;
+    }
+
+    ///Compute unit directions and lengths of subpath segments
+    void segment_dirs( const float* px, const float* py, uint np, bool closed )
+    {
+        uint nseg = closed ? np : np - 1;
+
+        _ux.resize(nseg);
+        _uy.resize(nseg);
+        _len.resize(nseg);
+
+        uint i = 0;
+        for (; i + 4 <= np - 1; i += 4)
+        {
+            __m128 dx = _mm_sub_ps(_mm_loadu_ps(px + i + 1), _mm_loadu_ps(px + i));
+            __m128 dy = _mm_sub_ps(_mm_loadu_ps(py + i + 1), _mm_loadu_ps(py + i));
+            __m128 l2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+            __m128 l = _mm_sqrt_ps(l2);
+
+            //zero length segments get zero direction
+            __m128 nz = _mm_cmpgt_ps(l, _mm_setzero_ps());
+            __m128 rl = _mm_and_ps(_mm_div_ps(_mm_set1_ps(1.0f), l), nz);
+
+            _mm_storeu_ps(_ux.ptr() + i, _mm_mul_ps(dx, rl));
+            _mm_storeu_ps(_uy.ptr() + i, _mm_mul_ps(dy, rl));
+            _mm_storeu_ps(_len.ptr() + i, l);
+        }
+
+        for (; i < nseg; ++i)
+        {
+            uint j = i + 1 < np ? i + 1 : 0;
+            float dx = px[j] - px[i];
+            float dy = py[j] - py[i];
+            float l = sqrtf(dx * dx + dy * dy);
+            float rl = l > 0 ? 1.0f / l : 0.0f;
+            _ux[i] = dx * rl;
+            _uy[i] = dy * rl;
+            _len[i] = l;
+        }
+    }
+
+    ///Extension of segments meeting at a vertex that covers the outer corner
+    float join_ext( uint a, uint b, float hw, float maxext ) const
+    {
+        //tan(theta/2) = |cross| / (1 + dot) for unit directions
+        float dot = _ux[a] * _ux[b] + _uy[a] * _uy[b];
+        float cross = fabsf(_ux[a] * _uy[b] - _uy[a] * _ux[b]);
+        if (dot <= -1.0f + 1e-6f)
+            return 0;
+
+        float e = hw * cross / (1.0f + dot);
+        return e < maxext ? e : maxext;
+    }
+
+    ///Scan convert the closed subpaths into spans
+    void build_fill()
+    {
+        _spans.reset();
+
+        uint np = uint(_x.size());
+        if (np < 3)
+            return;
+
+        float miny = _y[0], maxy = _y[0];
+        for (uint i = 1; i < np; ++i) {
+            miny = glm::min(miny, _y[i]);
+            maxy = glm::max(maxy, _y[i]);
+        }
+
+        //spans of the previous row, for vertical merging
+        uint prev_first = 0, prev_count = 0;
+        const float tol = _fill_tolerance;
+
+        for (float y = floorf(miny / _row) * _row; y < maxy; y += _row)
+        {
+            float yc = y + 0.5f * _row;
+
+            _xs.reset();
+            for (uint si = 0; si < _sub.size(); ++si) {
+                const subpath& sp = _sub[si];
+                const float* px = _x.ptr() + sp.first;
+                const float* py = _y.ptr() + sp.first;
+
+                for (uint i = 0, j = sp.count - 1; i < sp.count; j = i++) {
+                    if ((py[i] > yc) != (py[j] > yc))
+                        *_xs.add() = px[i] + (yc - py[i]) * (px[j] - px[i]) / (py[j] - py[i]);
+                }
+            }
+
+            uint nx = uint(_xs.size()) & ~1U;
+            std::sort(_xs.ptr(), _xs.ptr() + _xs.size());
+
+            //merge with the previous row if the spans are the same
+            uint nspan = nx / 2;
+            if (nspan && nspan == prev_count) {
+                bool same = true;
+                for (uint k = 0; k < nspan && same; ++k) {
+                    const float4& s = _spans[prev_first + k];
+                    same = fabsf(s.x - _xs[2*k]) < tol && fabsf(s.x + s.z - _xs[2*k + 1]) < tol;
+                }
+
+                if (same) {
+                    for (uint k = 0; k < nspan; ++k)
+                        _spans[prev_first + k].w += _row;
+                    continue;
+                }
+            }
+
+            prev_first = uint(_spans.size());
+
+            for (uint k = 0; k < nx; k += 2) {
+                if (_xs[k + 1] > _xs[k])
+                    *_spans.add() = float4(_xs[k], y, _xs[k + 1] - _xs[k], _row);
+            }
+            prev_count = uint(_spans.size()) - prev_first;
+        }
+    }
+
+private:
+
+    float _tolerance;
+
+    //flattened path
+    coid::dynarray<float> _x, _y;
+    coid::dynarray<subpath> _sub;
+
+    //cached stroke
+    coid::dynarray<float4> _segs;
+    coid::dynarray<float4> _bevels;
+    coid::dynarray<float> _bevel_width;
+    float _width = 0;
+    float _miter_limit = 0;
+    EJoin _join = JOIN_MITER;
+    ECap _cap = CAP_BUTT;
+    bool _stroke_valid = false;
+
+    //cached fill
+    coid::dynarray<float4> _spans;
+    float _row = 0;
+    float _fill_tolerance = 0;
+    bool _fill_valid = false;
+
+    //scratch
+    coid::dynarray<float> _ux, _uy, _len, _ext, _xs;
+};
+
+} //namespace ot
+
+#endif //__OT_CANVAS_PATH_H__
@@ -0,0 +1,99 @@
+#pragma once
+#ifndef __OT_CREATOR_TABLE_H__
+#define __OT_CREATOR_TABLE_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/dynarray.h>
+#include <comm/str.h>
+
+#include "object.h"
+#include "dynamic_object.h"
+#include "geomob.h"
+#include "vehicle_physics.h"
+
+/**
+    Load-time check of the interface creators used by a plugin.
+
+    Generated creators (object::get, geomob::from_entity_id, ...) look up
+    their creator in the interface register on first use, so a version
+    mismatch shows up only when the creator is first called, possibly deep
+    in a simulation step.
+
+    creator_table::resolve() looks up all the creators listed in ECreator
+    once, typically from the plugin initialization, and reports the ones
+    that are missing. The creators are still called through the generated
+    code, which keeps the typed signatures.
+
+    The keys are built from IFCNAME() and HASHID of the generated
+    interfaces, so they follow the interfaces when they are regenerated.
+
+    Example:
+        //plugin init
+        coid::dynarray<coid::charstr> missing;
+        if (ot::creator_table::resolve(&missing))
+            for (const coid::charstr& k : missing)
+                coidlog_error("plugin", "missing creator " << k);
+**/
+
+namespace ot {
+
+///Ids of the checked creators
+enum ECreator : uint {
+    CREATOR_OBJECT_GET,
+    CREATOR_DYNAMIC_OBJECT_GET,
+    CREATOR_GEOMOB_FROM_ENTITY_ID,
+    CREATOR_GEOMOB_CREATE2,
+    CREATOR_VEHICLE_PHYSICS_GET,
+
+    CREATOR_COUNT
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class creator_table
+{
+public:
+
+    ///Look up all creators in the interface register, call once at plugin load
+    //@param missing optional array receiving the keys of creators that could not be resolved
+    //@return number of creators that could not be resolved
+    static uint resolve( coid::dynarray<coid::charstr>* missing = 0 )
+    {
+        const coid::charstr keys[CREATOR_COUNT] = {
+            key<object>("get"_T, ".ifc"_T),
+            key<dynamic_object>("_get"_T),
+            key<geomob>("from_entity_id"_T),
+            key<geomob>("create2"_T),
+            key<vehicle_physics>("get"_T),
+        };
+
+        uint nmissing = 0;
+
+        for (uint i = 0; i < CREATOR_COUNT; ++i) {
+            if (coid::interface_register::get_interface_creator(keys[i]))
+                continue;
+
+            ++nmissing;
+            if (missing)
+                *missing->add() = keys[i];
+        }
+
+        return nmissing;
+    }
+
+private:
+
+    ///Creator key as in the generated code: ns::class.method@hash[suffix]
+    template <class T>
+    static coid::charstr key( const coid::token& method, const coid::token& suffix = coid::token() )
+    {
+        coid::charstr k;
+        k << T::IFCNAME() << '.' << method << '@' << uint(T::HASHID) << suffix;
+        return k;
+    }
+};
+
+} //namespace ot
+
+#endif //__OT_CREATOR_TABLE_H__
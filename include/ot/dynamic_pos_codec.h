@@ -0,0 +1,711 @@
+#pragma once
+#ifndef __OT_DYNAMIC_POS_CODEC_H__
+#define __OT_DYNAMIC_POS_CODEC_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+#include <immintrin.h>
+#include <bit>
+
+//F16C conversions of the velocity columns, SSE4.1 is implied
+//(MSVC /arch:AVX2 implies F16C, GCC/Clang -mavx2 does not)
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define DPC_F16C 1
+#endif
+
+#include "object_cfg.h"
+#include "cubeface.h"
+
+/**
+    Columnar binary snapshot codec for ot::dynamic_pos arrays.
+
+    Snapshot layout:
+        header
+        cell table (uint64 spherecoord keys)
+        15 columns (cell, pos xyz, rot index, rot abc, vel xyz, ang xyz, id),
+        each column split into blocks of 128 values, every block prefixed
+        by a byte with the bit width of the packed values
+
+    Positions are stored as fixed point offsets from the center of the
+    spherecoord cell they lie in, rotations as smallest-three quantized
+    quaternions and velocities as half floats.
+
+    When the previous snapshot had the same object count, the columns
+    are delta-encoded against it (zigzag coded differences), so slowly
+    moving or sleeping objects cost only a few bits per column.
+
+    SIMD paths use SSE2, and F16C with SSE4.1 when enabled at compile time
+    (-mf16c, /arch:AVX2), with a scalar fallback otherwise.
+
+    Round-trip error bounds:
+        position:   0.5 * pos_resolution per axis
+        rotation:   max_rot_component_error() per quaternion component
+        velocity:   2^-11 relative (half float)
+
+    Example:
+        ot::dynamic_pos_codec enc, dec;
+        coid::dynarray<uint8> buf;
+        enc.encode(ids, positions, count, false, buf);
+        ...
+        dec.decode(buf.ptr(), buf.size(), ids_out, positions_out);
+**/
+
+namespace ot {
+
+///Quantization setup of dynamic_pos snapshots
+struct dynamic_pos_codec_params
+{
+    double radius = rad_eq;             //< radius of the sphere with cell origins
+    uint cell_level = 12;               //< spherecoord level of position cells (~2.4km on Earth)
+    float pos_resolution = 1.0f/1024;   //< fixed point position step [m]
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///Stateful snapshot encoder/decoder
+//@note use one instance per stream direction, the instance keeps the last
+/// quantized snapshot as the reference for delta coding
+class dynamic_pos_codec
+{
+public:
+
+    enum {
+        MAGIC = 0x31737064,             //< 'dps1'
+        BLOCK = 128,                    //< values per bit-packed block
+
+        COL_CELL = 0,
+        COL_POS = 1,
+        COL_ROTI = 4,
+        COL_ROT = 5,
+        COL_VEL = 8,
+        COL_ANG = 11,
+        COL_ID = 14,
+        NCOLUMNS = 15,
+
+        FLAG_DELTA = 1,
+    };
+
+    ///Snapshot header
+    struct header
+    {
+        uint32 magic;
+        uint32 count;                   //< number of objects
+        uint32 ncells;                  //< number of entries in the cell table
+        uint8 flags;                    //< FLAG_DELTA if delta-encoded against the previous snapshot
+        uint8 cell_level;
+        uint16 reserved;
+        float pos_resolution;
+        uint32 reserved2;
+        double radius;
+    };
+
+    explicit dynamic_pos_codec( const dynamic_pos_codec_params& params = dynamic_pos_codec_params() )
+        : _params(params)
+    {}
+
+    const dynamic_pos_codec_params& params() const { return _params; }
+
+    ///Drop the reference snapshot, next encode produces a keyframe
+    void reset() {
+        _count = 0;
+        for (uint i = 0; i < NCOLUMNS; ++i)
+            _cols[i].reset();
+    }
+
+    //@return max position error per axis [m]
+    float max_pos_error() const { return 0.5f * _params.pos_resolution; }
+
+    //@return max error of a decoded quaternion component
+    static float max_rot_component_error() { return float(0.5 * M_SQRT2 / 32767); }
+
+    ///Encode snapshot
+    //@param ids object ids (stored as a column), can be null
+    //@param src positional data
+    //@param count number of objects
+    //@param keyframe true to force a full snapshot without delta coding
+    //@param out [out] encoded data, appended
+    //@return size of the encoded snapshot in bytes, 0 if a position is not finite or its
+    /// offset from the cell center doesn't fit the fixed point range at pos_resolution
+    uints encode( const uint* ids, const dynamic_pos* src, uint count, bool keyframe, coid::dynarray<uint8>& out )
+    {
+        const bool delta = !keyframe && _count == count && count > 0;
+
+        //keep previous quantized columns as the delta reference
+        for (uint i = 0; i < NCOLUMNS; ++i) {
+            _cols[i].swap(_prev[i]);
+            _cols[i].resize(count);
+        }
+        const uint prev_count = _count;
+        _count = count;
+
+        if (!quantize(ids, src, count)) {
+            //restore the reference snapshot
+            for (uint i = 0; i < NCOLUMNS; ++i)
+                _cols[i].swap(_prev[i]);
+            _count = prev_count;
+            return 0;
+        }
+
+        uints start = out.size();
+        uints nblocks = (count + BLOCK - 1) / BLOCK;
+        uint8* p = out.add(sizeof(header) + _cells.size() * sizeof(uint64)
+            + NCOLUMNS * (nblocks + count * sizeof(uint32)));
+
+        header* h = reinterpret_cast<header*>(p);
+        h->magic = MAGIC;
+        h->count = count;
+        h->ncells = uint32(_cells.size());
+        h->flags = delta ? FLAG_DELTA : 0;
+        h->cell_level = uint8(_params.cell_level);
+        h->reserved = 0;
+        h->pos_resolution = _params.pos_resolution;
+        h->reserved2 = 0;
+        h->radius = _params.radius;
+        p += sizeof(header);
+
+        ::memcpy(p, _cells.ptr(), _cells.size() * sizeof(uint64));
+        p += _cells.size() * sizeof(uint64);
+
+        _tmp.resize(count);
+        for (uint c = 0; c < NCOLUMNS; ++c) {
+            delta_zigzag(_cols[c].ptr(), delta ? _prev[c].ptr() : 0, _tmp.ptr(), count);
+
+            for (uint b = 0; b < count; b += BLOCK)
+                p = pack_block(_tmp.ptr() + b, count - b < BLOCK ? count - b : BLOCK, p);
+        }
+
+        out.resize(p - out.ptr());
+        return out.size() - start;
+    }
+
+    ///Decode snapshot
+    //@param data encoded snapshot
+    //@param size size of the encoded data
+    //@param ids [out] object ids
+    //@param dst [out] positional data
+    //@return number of bytes consumed, 0 on malformed data or missing delta reference
+    uints decode( const uint8* data, uints size, coid::dynarray<uint>& ids, coid::dynarray<dynamic_pos>& dst )
+    {
+        if (size < sizeof(header))
+            return 0;
+
+        header h;
+        ::memcpy(&h, data, sizeof(header));
+        if (h.magic != MAGIC)
+            return 0;
+
+        const bool delta = (h.flags & FLAG_DELTA) != 0;
+        if (delta && h.count != _count)
+            return 0;
+
+        const uint8* p = data + sizeof(header);
+        const uint8* pe = data + size;
+
+        if (uints(pe - p) < h.ncells * sizeof(uint64))
+            return 0;
+
+        //every block takes at least its bit width byte, reject counts the data can't hold
+        const uints nblocks = (uints(h.count) + BLOCK - 1) / BLOCK;
+        if (uints(pe - p) - h.ncells * sizeof(uint64) < NCOLUMNS * nblocks)
+            return 0;
+
+        _params.cell_level = h.cell_level;
+        _params.pos_resolution = h.pos_resolution;
+        _params.radius = h.radius;
+
+        _cells.resize(h.ncells);
+        ::memcpy(_cells.ptr(), p, h.ncells * sizeof(uint64));
+        p += h.ncells * sizeof(uint64);
+
+        uint count = h.count;
+        _count = count;
+        _tmp.resize(count);
+
+        for (uint c = 0; c < NCOLUMNS; ++c) {
+            for (uint b = 0; b < count; b += BLOCK) {
+                p = unpack_block(p, pe, count - b < BLOCK ? count - b : BLOCK, _tmp.ptr() + b);
+                if (!p) {
+                    _count = 0;
+                    return 0;
+                }
+            }
+
+            if (!delta)
+                _cols[c].resize(count);
+            undelta_zigzag(_tmp.ptr(), delta ? _cols[c].ptr() : 0, _cols[c].ptr(), count);
+        }
+
+        //cell indices must reference the cell table
+        const uint32* cell = _cols[COL_CELL].ptr();
+        for (uint i = 0; i < count; ++i)
+            if (cell[i] >= h.ncells) {
+                _count = 0;
+                return 0;
+            }
+
+        ids.resize(count);
+        dst.resize(count);
+        dequantize(ids.ptr(), dst.ptr(), count);
+        return p - data;
+    }
+
+private:
+
+    ////////////////////////////////////////////////////////////////////////////////
+    ///Convert input into quantized integer columns
+    //@return false if a position offset is out of the fixed point range
+    bool quantize( const uint* ids, const dynamic_pos* src, uint count )
+    {
+        _cells.reset();
+        _cell_map.reset();
+        _cell_origins.reset();
+
+        uint32* col[NCOLUMNS];
+        for (uint c = 0; c < NCOLUMNS; ++c)
+            col[c] = _cols[c].ptr();
+
+        const __m128d inv_res = _mm_set1_pd(1.0 / _params.pos_resolution);
+        const __m128d absmaskd = _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffffLL));
+        const __m128d limit = _mm_set1_pd(2147483647.0);
+        __m128d over = _mm_setzero_pd();
+        uint64 last_key = UMAX64;
+        uint last_cell = 0;
+
+        for (uint i = 0; i < count; ++i)
+        {
+            const dynamic_pos& dp = src[i];
+
+            //cell lookup, consecutive objects are usually in the same cell
+            uint64 key = cell_key(dp.pos);
+            if (key != last_key) {
+                last_cell = find_cell(key);
+                last_key = key;
+            }
+
+            const double3& org = _cell_origins[last_cell];
+            __m128d xy = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(&dp.pos.x), _mm_loadu_pd(&org.x)), inv_res);
+            __m128d zz = _mm_mul_pd(_mm_sub_pd(_mm_set1_pd(dp.pos.z), _mm_set1_pd(org.z)), inv_res);
+
+            //cvtpd saturates silently, flag offsets out of the int32 range (and NaNs)
+            over = _mm_or_pd(over, _mm_cmpnlt_pd(_mm_and_pd(xy, absmaskd), limit));
+            over = _mm_or_pd(over, _mm_cmpnlt_pd(_mm_and_pd(zz, absmaskd), limit));
+
+            __m128i ixy = _mm_cvtpd_epi32(xy);
+            __m128i iz = _mm_cvtpd_epi32(zz);
+
+            col[COL_CELL][i] = last_cell;
+            col[COL_POS+0][i] = uint32(_mm_cvtsi128_si32(ixy));
+            col[COL_POS+1][i] = uint32(_mm_cvtsi128_si32(_mm_shuffle_epi32(ixy, _MM_SHUFFLE(1, 1, 1, 1))));
+            col[COL_POS+2][i] = uint32(_mm_cvtsi128_si32(iz));
+
+            col[COL_ID][i] = ids ? ids[i] : i;
+        }
+
+        if (_mm_movemask_pd(over))
+            return false;
+
+        //rotations, 4 objects at a time
+        const __m128 rscale = _mm_set1_ps(float(M_SQRT2 * 32767));
+        const __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+        uint i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            const dynamic_pos* d = src + i;
+
+            __m128 qx = _mm_setr_ps(d[0].rot.x, d[1].rot.x, d[2].rot.x, d[3].rot.x);
+            __m128 qy = _mm_setr_ps(d[0].rot.y, d[1].rot.y, d[2].rot.y, d[3].rot.y);
+            __m128 qz = _mm_setr_ps(d[0].rot.z, d[1].rot.z, d[2].rot.z, d[3].rot.z);
+            __m128 qw = _mm_setr_ps(d[0].rot.w, d[1].rot.w, d[2].rot.w, d[3].rot.w);
+
+            //find the largest component per lane
+            __m128 ax = _mm_and_ps(qx, absmask), ay = _mm_and_ps(qy, absmask);
+            __m128 az = _mm_and_ps(qz, absmask), aw = _mm_and_ps(qw, absmask);
+
+            __m128i idx = _mm_setzero_si128();
+            __m128 amax = ax;
+            __m128 m = _mm_cmpgt_ps(ay, amax);
+            idx = _mm_or_si128(_mm_andnot_si128(_mm_castps_si128(m), idx), _mm_and_si128(_mm_castps_si128(m), _mm_set1_epi32(1)));
+            amax = _mm_max_ps(amax, ay);
+            m = _mm_cmpgt_ps(az, amax);
+            idx = _mm_or_si128(_mm_andnot_si128(_mm_castps_si128(m), idx), _mm_and_si128(_mm_castps_si128(m), _mm_set1_epi32(2)));
+            amax = _mm_max_ps(amax, az);
+            m = _mm_cmpgt_ps(aw, amax);
+            idx = _mm_or_si128(_mm_andnot_si128(_mm_castps_si128(m), idx), _mm_and_si128(_mm_castps_si128(m), _mm_set1_epi32(3)));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(col[COL_ROTI] + i), idx);
+
+            //drop the largest component, flip the sign so that it's positive
+            alignas(16) float qc[4][4];
+            _mm_store_ps(qc[0], qx);
+            _mm_store_ps(qc[1], qy);
+            _mm_store_ps(qc[2], qz);
+            _mm_store_ps(qc[3], qw);
+
+            alignas(16) uint32 ii[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(ii), idx);
+
+            alignas(16) float abc[3][4];
+            for (uint k = 0; k < 4; ++k) {
+                uint mi = ii[k];
+                float s = qc[mi][k] < 0 ? -1.0f : 1.0f;
+                for (uint j = 0, o = 0; j < 4; ++j)
+                    if (j != mi)
+                        abc[o++][k] = s * qc[j][k];
+            }
+
+            for (uint j = 0; j < 3; ++j) {
+                __m128i v = _mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(abc[j]), rscale));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(col[COL_ROT+j] + i), v);
+            }
+        }
+
+        for (; i < count; ++i)
+        {
+            const dynamic_pos& dp = src[i];
+            const float qc[4] = { dp.rot.x, dp.rot.y, dp.rot.z, dp.rot.w };
+
+            uint mi = 0;
+            for (uint j = 1; j < 4; ++j)
+                if (fabs(qc[j]) > fabs(qc[mi]))
+                    mi = j;
+
+            float s = qc[mi] < 0 ? -1.0f : 1.0f;
+            col[COL_ROTI][i] = mi;
+            for (uint j = 0, o = 0; j < 4; ++j)
+                if (j != mi)
+                    col[COL_ROT + o++][i] = uint32(int(lrintf(s * qc[j] * float(M_SQRT2 * 32767))));
+        }
+
+        //velocities to half floats
+        i = 0;
+#ifdef DPC_F16C
+        for (; i + 4 <= count; i += 4)
+        {
+            const dynamic_pos* d = src + i;
+
+            for (uint j = 0; j < 3; ++j) {
+                __m128 v = _mm_setr_ps(d[0].vel[j], d[1].vel[j], d[2].vel[j], d[3].vel[j]);
+                __m128 a = _mm_setr_ps(d[0].ang[j], d[1].ang[j], d[2].ang[j], d[3].ang[j]);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(col[COL_VEL+j] + i),
+                    _mm_cvtepu16_epi32(_mm_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT)));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(col[COL_ANG+j] + i),
+                    _mm_cvtepu16_epi32(_mm_cvtps_ph(a, _MM_FROUND_TO_NEAREST_INT)));
+            }
+        }
+#endif
+
+        for (; i < count; ++i) {
+            for (uint j = 0; j < 3; ++j) {
+                col[COL_VEL+j][i] = float_to_half(src[i].vel[j]);
+                col[COL_ANG+j][i] = float_to_half(src[i].ang[j]);
+            }
+        }
+
+        return true;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+    ///Convert quantized columns back to positional data
+    void dequantize( uint* ids, dynamic_pos* dst, uint count )
+    {
+        _cell_origins.resize(_cells.size());
+        for (uints c = 0; c < _cells.size(); ++c)
+            _cell_origins[c] = spherecoord(_cells[c]).xyz() * _params.radius;
+
+        const uint32* col[NCOLUMNS];
+        for (uint c = 0; c < NCOLUMNS; ++c)
+            col[c] = _cols[c].ptr();
+
+        const double res = _params.pos_resolution;
+
+        for (uint i = 0; i < count; ++i) {
+            const double3& org = _cell_origins[col[COL_CELL][i]];
+            dst[i].pos = org + double3(
+                double(int(col[COL_POS+0][i])) * res,
+                double(int(col[COL_POS+1][i])) * res,
+                double(int(col[COL_POS+2][i])) * res);
+
+            ids[i] = col[COL_ID][i];
+        }
+
+        const __m128 rscale = _mm_set1_ps(float(1.0 / (M_SQRT2 * 32767)));
+        const __m128 one = _mm_set1_ps(1.0f);
+
+        uint i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            dynamic_pos* d = dst + i;
+
+            __m128 a = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(col[COL_ROT+0] + i))), rscale);
+            __m128 b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(col[COL_ROT+1] + i))), rscale);
+            __m128 c = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(col[COL_ROT+2] + i))), rscale);
+
+            //reconstruct the dropped component
+            __m128 dd = _mm_sub_ps(one, _mm_add_ps(_mm_mul_ps(a, a), _mm_add_ps(_mm_mul_ps(b, b), _mm_mul_ps(c, c))));
+            dd = _mm_sqrt_ps(_mm_max_ps(dd, _mm_setzero_ps()));
+
+            alignas(16) float qc[4][4];
+            _mm_store_ps(qc[0], a);
+            _mm_store_ps(qc[1], b);
+            _mm_store_ps(qc[2], c);
+            _mm_store_ps(qc[3], dd);
+
+            for (uint k = 0; k < 4; ++k) {
+                uint mi = col[COL_ROTI][i+k] & 3;
+                float q[4];
+                for (uint j = 0, o = 0; j < 4; ++j)
+                    q[j] = j == mi ? qc[3][k] : qc[o++][k];
+                d[k].rot = glm::normalize(quat(q[3], q[0], q[1], q[2]));
+            }
+        }
+
+        for (; i < count; ++i)
+        {
+            float abc[3];
+            for (uint j = 0; j < 3; ++j)
+                abc[j] = float(int(col[COL_ROT+j][i])) * float(1.0 / (M_SQRT2 * 32767));
+
+            float dd = glm::sqrtc(1.0f - abc[0]*abc[0] - abc[1]*abc[1] - abc[2]*abc[2]);
+            uint mi = col[COL_ROTI][i] & 3;
+
+            float q[4];
+            for (uint j = 0, o = 0; j < 4; ++j)
+                q[j] = j == mi ? dd : abc[o++];
+            dst[i].rot = glm::normalize(quat(q[3], q[0], q[1], q[2]));
+        }
+
+        //velocities from half floats
+        i = 0;
+#ifdef DPC_F16C
+        for (; i + 4 <= count; i += 4)
+        {
+            dynamic_pos* d = dst + i;
+
+            for (uint j = 0; j < 3; ++j) {
+                __m128i hv = _mm_packus_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(col[COL_VEL+j] + i)), _mm_setzero_si128());
+                __m128i ha = _mm_packus_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(col[COL_ANG+j] + i)), _mm_setzero_si128());
+
+                alignas(16) float v[4], w[4];
+                _mm_store_ps(v, _mm_cvtph_ps(hv));
+                _mm_store_ps(w, _mm_cvtph_ps(ha));
+
+                for (uint k = 0; k < 4; ++k) {
+                    d[k].vel[j] = v[k];
+                    d[k].ang[j] = w[k];
+                }
+            }
+        }
+#endif
+
+        for (; i < count; ++i) {
+            for (uint j = 0; j < 3; ++j) {
+                dst[i].vel[j] = half_to_float(col[COL_VEL+j][i]);
+                dst[i].ang[j] = half_to_float(col[COL_ANG+j][i]);
+            }
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+    ///Float to half float, round to nearest even
+    static uint32 float_to_half( float f )
+    {
+#ifdef DPC_F16C
+        return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#else
+        uint32 x = std::bit_cast<uint32>(f);
+        uint32 sign = (x >> 16) & 0x8000;
+        x &= 0x7fffffff;
+
+        uint32 h;
+        if (x >= 0x47800000)                //>= 65536, inf or nan
+            h = x > 0x7f800000 ? 0x7e00 : 0x7c00;
+        else if (x < 0x38800000) {          //subnormal or zero, align the mantissa by adding 0.5
+            float t = std::bit_cast<float>(x) + 0.5f;
+            h = std::bit_cast<uint32>(t) - 0x3f000000;
+        }
+        else {
+            uint32 odd = (x >> 13) & 1;
+            x += 0xc8000fffU + odd;         //rebias the exponent and round
+            h = x >> 13;
+        }
+        return sign | h;
+#endif
+    }
+
+    static float half_to_float( uint32 h )
+    {
+#ifdef DPC_F16C
+        return _cvtsh_ss(ushort(h));
+#else
+        uint32 x = (h & 0x7fff) << 13;
+        uint32 e = x & 0x0f800000;
+        x += 0x38000000;                    //rebias the exponent
+        if (e == 0x0f800000)
+            x += 0x38000000;                //inf or nan
+        else if (!e) {
+            x += 0x00800000;                //subnormal or zero, renormalize
+            x = std::bit_cast<uint32>(std::bit_cast<float>(x) - 6.103515625e-05f);
+        }
+        return std::bit_cast<float>(x | ((h & 0x8000) << 16));
+#endif
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+    //@return spherecoord key of the cell containing given position
+    uint64 cell_key( const double3& pos ) const
+    {
+        int hv[2];
+        int face = xyz_to_cubeface(&pos.x, hv);
+        return spherecoord(face, hv[0], hv[1], _params.cell_level);
+    }
+
+    //@return index of the cell in the cell table, adding it if not present yet
+    uint find_cell( uint64 key )
+    {
+        //open addressing hash map, resized at 50% load
+        if (_cell_map.size() < 2 * (_cells.size() + 1)) {
+            uints n = _cell_map.size() ? _cell_map.size() * 2 : 64;
+            _cell_map.resize(n);
+            ::memset(_cell_map.ptr(), 0xff, n * sizeof(uint));
+
+            for (uint c = 0; c < _cells.size(); ++c)
+                _cell_map[probe(_cells[c])] = c;
+        }
+
+        uints slot = probe(key);
+        uint& c = _cell_map[slot];
+        if (c == UMAX32) {
+            c = uint(_cells.size());
+            *_cells.add() = key;
+            *_cell_origins.add() = spherecoord(key).xyz() * _params.radius;
+        }
+        return c;
+    }
+
+    uints probe( uint64 key ) const
+    {
+        uints mask = _cell_map.size() - 1;
+        uints slot = uints((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+        while (_cell_map[slot] != UMAX32 && _cells[_cell_map[slot]] != key)
+            slot = (slot + 1) & mask;
+        return slot;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+    ///Compute zigzag coded differences against the reference column
+    static void delta_zigzag( const uint32* src, const uint32* ref, uint32* dst, uint count )
+    {
+        uint i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            if (ref)
+                v = _mm_sub_epi32(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(ref + i)));
+            v = _mm_xor_si128(_mm_slli_epi32(v, 1), _mm_srai_epi32(v, 31));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+        }
+        for (; i < count; ++i) {
+            int32 v = int32(src[i] - (ref ? ref[i] : 0));
+            dst[i] = (uint32(v) << 1) ^ uint32(v >> 31);
+        }
+    }
+
+    ///Inverse of delta_zigzag, ref and dst may alias
+    static void undelta_zigzag( const uint32* src, const uint32* ref, uint32* dst, uint count )
+    {
+        const __m128i one = _mm_set1_epi32(1);
+
+        uint i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            v = _mm_xor_si128(_mm_srli_epi32(v, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(v, one)));
+            if (ref)
+                v = _mm_add_epi32(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(ref + i)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+        }
+        for (; i < count; ++i) {
+            uint32 v = (src[i] >> 1) ^ (0U - (src[i] & 1));
+            dst[i] = v + (ref ? ref[i] : 0);
+        }
+    }
+
+    ///Bit-pack a block of values with the minimal common bit width
+    static uint8* pack_block( const uint32* v, uint n, uint8* dst )
+    {
+        uint32 m = 0;
+        for (uint i = 0; i < n; ++i)
+            m |= v[i];
+
+        const uint w = std::bit_width(m);
+        *dst++ = uint8(w);
+        if (!w)
+            return dst;
+
+        uint64 acc = 0;
+        uint bits = 0;
+        for (uint i = 0; i < n; ++i) {
+            acc |= uint64(v[i]) << bits;
+            bits += w;
+            while (bits >= 8) {
+                *dst++ = uint8(acc);
+                acc >>= 8;
+                bits -= 8;
+            }
+        }
+        if (bits)
+            *dst++ = uint8(acc);
+        return dst;
+    }
+
+    //@return pointer past the block, 0 if the data are malformed
+    static const uint8* unpack_block( const uint8* p, const uint8* pe, uint n, uint32* v )
+    {
+        if (p >= pe)
+            return 0;
+
+        const uint w = *p++;
+        if (w > 32)
+            return 0;
+        if (!w) {
+            ::memset(v, 0, n * sizeof(uint32));
+            return p;
+        }
+
+        uints nbytes = (uints(n) * w + 7) / 8;
+        if (uints(pe - p) < nbytes)
+            return 0;
+
+        const uint64 mask = (uint64(1) << w) - 1;
+        uint64 acc = 0;
+        uint bits = 0;
+        for (uint i = 0; i < n; ++i) {
+            while (bits < w) {
+                acc |= uint64(*p++) << bits;
+                bits += 8;
+            }
+            v[i] = uint32(acc & mask);
+            acc >>= w;
+            bits -= w;
+        }
+        return p;
+    }
+
+private:
+
+    dynamic_pos_codec_params _params;
+
+    uint _count = 0;                            //< object count of the reference snapshot
+    coid::dynarray<uint32> _cols[NCOLUMNS];     //< quantized columns of the last snapshot
+    coid::dynarray<uint32> _prev[NCOLUMNS];     //< previous quantized columns (encoder)
+    coid::dynarray<uint32> _tmp;
+
+    coid::dynarray<uint64> _cells;              //< spherecoord keys of the cells in use
+    coid::dynarray<double3> _cell_origins;      //< cell centers
+    coid::dynarray<uint> _cell_map;             //< key hash -> cell index
+};
+
+} //namespace ot
+
+#endif //__OT_DYNAMIC_POS_CODEC_H__
@@ -0,0 +1,355 @@
+#pragma once
+#ifndef __OT_DYNAMIC_POS_PLAYOUT_H__
+#define __OT_DYNAMIC_POS_PLAYOUT_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+
+#include "object.h"
+#include "object_cfg.h"
+#include "glm/glm_ext.h"
+
+/**
+    Playout (jitter buffer + dead reckoning) of networked dynamic_pos streams.
+
+    Each remote entity has a small ring of timestamped snapshots. On update
+    the entity is rendered at (now - delay), where the delay adapts to the
+    observed packet interval and jitter:
+        - between two snapshots the position is Hermite-interpolated using
+          the snapshot velocities, rotation is slerped
+        - past the newest snapshot the state is extrapolated with
+          dynamic_pos::predict_position, for at most max_extrapolation
+          seconds
+        - when a new snapshot changes the trajectory, the difference between
+          the old and new rendered state is kept as an error offset that
+          decays over correction_time, instead of snapping
+
+    All entity state is kept in SoA arrays, update() walks them linearly and
+    apply() pushes the results to the objects in a single pass.
+
+    Example:
+        ot::dynamic_pos_playout playout;
+        uint e = playout.add_entity();
+        ...
+        playout.push(e, packet_time, packet_pos);      //on receive
+        ...
+        playout.update(now);                            //once per frame
+        playout.apply(objects.ptr());
+**/
+
+namespace ot {
+
+///Playout configuration
+struct dynamic_pos_playout_params
+{
+    float min_delay = 0.05f;            //< minimal playout delay [s]
+    float max_delay = 0.3f;             //< maximal playout delay [s]
+    float jitter_mult = 2.0f;           //< delay = interval + jitter_mult * jitter
+    float max_extrapolation = 0.25f;    //< max time to extrapolate past the newest snapshot [s]
+    float correction_time = 0.2f;       //< time constant of the error correction [s]
+    float snap_distance = 20.0f;        //< position error above which the entity snaps [m]
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class dynamic_pos_playout
+{
+public:
+
+    enum {
+        RING = 8,                       //< snapshots kept per entity
+    };
+
+    ///Per-frame statistics
+    struct stats
+    {
+        uint interpolated = 0;          //< entities rendered between two snapshots
+        uint extrapolated = 0;          //< entities rendered past the newest snapshot
+        uint starved = 0;               //< entities that ran out of the extrapolation limit
+        uint out_of_order = 0;          //< snapshots dropped because not newer than the last received one
+    };
+
+    explicit dynamic_pos_playout( const dynamic_pos_playout_params& params = dynamic_pos_playout_params() )
+        : _params(params)
+    {}
+
+    dynamic_pos_playout_params& params() { return _params; }
+
+    //@return entity slot
+    uint add_entity()
+    {
+        uint e;
+        if (_free.size()) {
+            e = _free.last();
+            _free.resize(_free.size() - 1);
+        }
+        else {
+            e = uint(_count.size());
+            uint n = e + 1;
+            _count.resize(n);
+            _head.resize(n);
+            _active.resize(n);
+            _interval.resize(n);
+            _jitter.resize(n);
+            _err_pos.resize(n);
+            _err_rot.resize(n);
+            _out.resize(n);
+
+            _time.resize(n * RING);
+            _snap.resize(n * RING);
+        }
+
+        _count[e] = 0;
+        _head[e] = 0;
+        _active[e] = ACTIVE;
+        _interval[e] = 0.1f;
+        _jitter[e] = 0;
+        _err_pos[e] = float3(0);
+        _err_rot[e] = quat(1, 0, 0, 0);
+        return e;
+    }
+
+    void remove_entity( uint e )
+    {
+        DASSERT(_active[e]);
+        _active[e] = INACTIVE;
+        _count[e] = 0;
+        *_free.add() = e;
+    }
+
+    ///Push received snapshot
+    //@param e entity slot
+    //@param time snapshot time in local clock [s]
+    //@param dp positional data
+    void push( uint e, double time, const dynamic_pos& dp )
+    {
+        uint n = _count[e];
+        uint base = e * RING;
+
+        if (n) {
+            double tlast = _time[base + _head[e]];
+            if (time <= tlast) {
+                //out of order or duplicate
+                ++_out_of_order;
+                return;
+            }
+
+            //adaptive interval and jitter estimate
+            float dt = float(time - tlast);
+            float dev = fabs(dt - _interval[e]);
+            _interval[e] += (dt - _interval[e]) * 0.1f;
+            _jitter[e] += (dev - _jitter[e]) * 0.1f;
+        }
+
+        uint h = n ? (_head[e] + 1) & (RING - 1) : 0;
+        _head[e] = h;
+        _count[e] = n < RING ? n + 1 : RING;
+        _time[base + h] = time;
+        _snap[base + h] = dp;
+
+        //keep the currently rendered state, the new trajectory gets corrected towards it
+        if (n && _active[e] == RENDERED) {
+            dynamic_pos est;
+            evaluate(e, _last_time - delay(e), est);
+
+            double3 dpos = _out[e].pos - est.pos;
+            if (glm::length_squared(dpos) > double(_params.snap_distance) * _params.snap_distance) {
+                _err_pos[e] = float3(0);
+                _err_rot[e] = quat(1, 0, 0, 0);
+            }
+            else {
+                _err_pos[e] = float3(dpos);
+                //shortest arc, so that the decay towards identity can't pass through zero
+                quat err = _out[e].rot * glm::conjugate(est.rot);
+                _err_rot[e] = err.w < 0 ? -err : err;
+            }
+        }
+    }
+
+    ///Compute playout state of all entities
+    //@param now current local time [s]
+    void update( double now )
+    {
+        float dt = _last_time > 0 ? float(now - _last_time) : 0.0f;
+        _last_time = now;
+        _stats = stats();
+        _stats.out_of_order = _out_of_order;
+        _out_of_order = 0;
+
+        //exponential decay of the error offsets
+        float k = _params.correction_time > 0
+            ? expf(-dt / _params.correction_time)
+            : 0.0f;
+
+        uint n = uint(_count.size());
+        for (uint e = 0; e < n; ++e)
+        {
+            if (!_count[e])
+                continue;
+
+            dynamic_pos& out = _out[e];
+            switch (evaluate(e, now - delay(e), out)) {
+            case INTERPOLATED: ++_stats.interpolated; break;
+            case EXTRAPOLATED: ++_stats.extrapolated; break;
+            case STARVED: ++_stats.starved; break;
+            }
+            _active[e] = RENDERED;
+
+            _err_pos[e] *= k;
+            _err_rot[e] = glm::lerp(quat(1, 0, 0, 0), _err_rot[e], k);
+            _err_rot[e] = glm::normalize(_err_rot[e]);
+
+            out.pos += double3(_err_pos[e]);
+            out.rot = glm::normalize(_err_rot[e] * out.rot);
+        }
+    }
+
+    ///Apply the computed state to the scene objects
+    //@param objs objects indexed by entity slot, null entries are skipped
+    //@return number of objects updated
+    uint apply( const iref<ot::object>* objs ) const
+    {
+        uint n = uint(_count.size());
+        uint nset = 0;
+
+        for (uint e = 0; e < n; ++e) {
+            if (!_count[e] || !objs[e])
+                continue;
+
+            if (objs[e]->set_positional_data(_out[e]))
+                ++nset;
+        }
+        return nset;
+    }
+
+    //@return playout state of given entity computed by the last update()
+    const dynamic_pos& get( uint e ) const { return _out[e]; }
+
+    //@return array of playout states indexed by entity slot
+    const dynamic_pos* states() const { return _out.ptr(); }
+
+    //@return number of entity slots
+    uint size() const { return uint(_count.size()); }
+
+    //@return current playout delay of given entity [s]
+    float delay( uint e ) const {
+        float d = _interval[e] + _params.jitter_mult * _jitter[e];
+        return d < _params.min_delay ? _params.min_delay
+            : (d > _params.max_delay ? _params.max_delay : d);
+    }
+
+    const stats& get_stats() const { return _stats; }
+
+private:
+
+    enum EEntityState {
+        INACTIVE = 0,
+        ACTIVE,                         //< has no playout state yet
+        RENDERED,                       //< _out contains the last rendered state
+    };
+
+    enum EEvalResult {
+        INTERPOLATED,
+        EXTRAPOLATED,
+        STARVED,
+        CLAMPED,
+    };
+
+    ///Evaluate entity state at given time from the snapshot ring
+    //@return INTERPOLATED, EXTRAPOLATED, STARVED or CLAMPED
+    int evaluate( uint e, double t, dynamic_pos& out ) const
+    {
+        uint n = _count[e];
+        uint base = e * RING;
+        uint h = _head[e];
+
+        const double* time = _time.ptr() + base;
+        const dynamic_pos* snap = _snap.ptr() + base;
+
+        //newest snapshot older than the playout time: extrapolate
+        if (t >= time[h]) {
+            float dt = float(t - time[h]);
+            bool starved = dt > _params.max_extrapolation;
+            if (starved)
+                dt = _params.max_extrapolation;
+
+            out.vel = snap[h].vel;
+            out.ang = snap[h].ang;
+            snap[h].predict_position(dt, out);
+            return starved ? STARVED : EXTRAPOLATED;
+        }
+
+        //find the bracketing pair, walking from the newest
+        uint i1 = h;
+        for (uint k = 1; k < n; ++k) {
+            uint i0 = (h - k) & (RING - 1);
+            if (time[i0] <= t) {
+                hermite(snap[i0], snap[i1], time[i0], time[i1], t, out);
+                return INTERPOLATED;
+            }
+            i1 = i0;
+        }
+
+        //older than the oldest snapshot
+        out = snap[i1];
+        return CLAMPED;
+    }
+
+    ///Cubic Hermite interpolation of positions using the snapshot velocities
+    static void hermite( const dynamic_pos& a, const dynamic_pos& b, double ta, double tb, double t, dynamic_pos& out )
+    {
+        float h = float(tb - ta);
+        float s = float((t - ta) / (tb - ta));
+        float s2 = s * s;
+        float s3 = s2 * s;
+
+        float h10 = s3 - 2*s2 + s;
+        float h01 = -2*s3 + 3*s2;
+        float h11 = s3 - s2;
+
+        //relative to a to keep float precision (h00 + h01 = 1)
+        float3 d = float3(b.pos - a.pos);
+        float3 p = h10 * h * a.vel + h01 * d + h11 * h * b.vel;
+        out.pos = a.pos + double3(p);
+
+        //derivative for the output velocity
+        float d00 = 6*s2 - 6*s;
+        float d10 = 3*s2 - 4*s + 1;
+        float d01 = -d00;
+        float d11 = 3*s2 - 2*s;
+        out.vel = (d01 * d) / h + d10 * a.vel + d11 * b.vel;
+
+        out.rot = glm::slerp(a.rot, b.rot, s);
+        out.ang = a.ang + (b.ang - a.ang) * s;
+    }
+
+private:
+
+    dynamic_pos_playout_params _params;
+
+    //per-entity state
+    coid::dynarray<uint8> _count;           //< snapshots in the ring, 0 for inactive entities
+    coid::dynarray<uint8> _head;            //< index of the newest snapshot
+    coid::dynarray<uint8> _active;          //< EEntityState
+    coid::dynarray<float> _interval;        //< smoothed snapshot interval
+    coid::dynarray<float> _jitter;          //< smoothed interval deviation
+    coid::dynarray<float3> _err_pos;        //< decaying position correction
+    coid::dynarray<quat> _err_rot;          //< decaying rotation correction
+    coid::dynarray<dynamic_pos> _out;       //< playout state
+
+    //per-entity rings, RING entries per entity
+    coid::dynarray<double> _time;
+    coid::dynarray<dynamic_pos> _snap;
+
+    coid::dynarray<uint> _free;
+
+    double _last_time = 0;
+    uint _out_of_order = 0;
+    stats _stats;
+};
+
+} //namespace ot
+
+#endif //__OT_DYNAMIC_POS_PLAYOUT_H__
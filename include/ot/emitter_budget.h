@@ -0,0 +1,568 @@
+#pragma once
+#ifndef __OT_EMITTER_BUDGET_H__
+#define __OT_EMITTER_BUDGET_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+
+#include <algorithm>
+
+#include "explosions.h"
+#include "cubeface.h"
+#include "glm/glm_ext.h"
+
+/**
+    Budgeted emitter manager on top of ot::explosions.
+
+    Smoke and solid particle emitters, combo explosions and flashes are not
+    created directly, but queued as requests during the frame. commit() then
+    processes all requests at once:
+        - requests beyond max_distance from the camera are culled
+        - requests of the same kind in the same spherecoord cell that lie
+          within merge_distance of each other are merged into a single,
+          larger emitter (sweep along x within the cell, at most
+          merge_candidates tested per request)
+        - each request gets a score from its importance, size and distance;
+          global and per-cell caps are enforced by dropping the lowest
+          scoring requests, or by evicting live emitters that score lower
+        - host emitter ids of expired and evicted emitters are recycled
+          through the id parameter of create_smoke/create_solid_particles
+
+    Example:
+        ot::emitter_budget eb(ot::explosions::get());
+
+        ot::smoke_desc sd;
+        sd.pos = hit_pos;
+        sd.norm = float3(glm::normalize(hit_pos));
+        eb.create_smoke(sd, 2.0f);
+        ...
+        eb.commit(camera_pos, dt);                      //once per frame
+        const ot::emitter_budget::stats& st = eb.get_stats();
+**/
+
+namespace ot {
+
+///Smoke emitter parameters, see explosions::create_smoke
+struct smoke_desc
+{
+    double3 pos;
+    float3 norm;
+    float radius = 5.0f;
+    float speed = 2.0f;
+    float density = 1.0f;
+    float fade_time = 20.0f;
+    float timeout = 10.0f;
+    float3 color = float3(0.1f);
+    float age = 0;
+};
+
+///Solid particle emitter parameters, see explosions::create_solid_particles
+struct solids_desc
+{
+    double3 pos;
+    float3 norm;
+    float emitter_radius = 2.0f;
+    float particle_radius = 0.05f;
+    float speed = 20.0f;
+    float spread = 0.4f;
+    float highlight = 0.0f;
+    float age = 0;
+    float3 bcolor = float3(0.03, 0.02, 0.01);
+    float4 hcolor = float4(40, 6, 0, 10);
+};
+
+///Combo explosion parameters, see explosions::launch_combo
+struct combo_desc
+{
+    double3 pos;
+    float3 speed;
+    float size = 1.0f;
+    float3 color = float3(1);
+    float3 smoke_color = float3(0.1f);
+    float emitter_radius = 2.0f;
+    float emitter_speed = 10.0f;
+    float particle_size = 0.05f;
+    float smoke_timeout = 10.0f;
+    bool crater = true;
+    bool solids = true;
+    bool smoke = true;
+};
+
+///Flash parameters, see explosions::flash
+struct flash_desc
+{
+    double3 pos;
+    float intensity = 1.0f;
+    float4 color = float4(1);
+    float range = 100.0f;
+    float timeout = 0.1f;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class emitter_budget
+{
+public:
+
+    ///Budget configuration
+    struct params
+    {
+        uint max_smoke = 256;               //< max live smoke emitters
+        uint max_solids = 256;              //< max live solid particle emitters
+        uint max_per_cell = 16;             //< max live emitters of one kind per cell
+        uint max_combos = 32;               //< max combo explosions launched per frame
+        uint max_flashes = 32;              //< max flashes per frame
+        uint cell_level = 14;               //< spherecoord level of the binning cells (~600m on Earth)
+        float merge_distance = 10.0f;       //< distance under which requests of the same kind are merged [m]
+        uint merge_candidates = 32;         //< max requests tested for merging with one request
+        float max_distance = 20000.0f;      //< requests farther from the camera are culled [m]
+        float solids_lifetime = 5.0f;       //< assumed lifetime of solid particle emitters [s]
+    };
+
+    ///Per-frame statistics
+    struct stats
+    {
+        uint requested = 0;                 //< requests queued in the frame
+        uint merged = 0;                    //< requests merged into other requests
+        uint culled_distance = 0;           //< requests culled by distance
+        uint culled_budget = 0;             //< requests dropped by the caps
+        uint evicted = 0;                   //< live emitters destroyed to make room
+        uint created = 0;                   //< emitters created in the host
+        uint combos = 0;                    //< combo explosions launched
+        uint flashes = 0;                   //< flashes created
+        uint live_smoke = 0;                //< live smoke emitters after commit
+        uint live_solids = 0;               //< live solid particle emitters after commit
+    };
+
+    explicit emitter_budget( const iref<explosions>& exp )
+        : emitter_budget(exp, params())
+    {}
+
+    emitter_budget( const iref<explosions>& exp, const params& p )
+        : _exp(exp)
+        , _params(p)
+    {}
+
+    params& get_params() { return _params; }
+
+    const stats& get_stats() const { return _stats; }
+
+    //@{ Queue requests
+    //@param importance relative importance of the effect, scales the score
+    void create_smoke( const smoke_desc& d, float importance = 1.0f ) {
+        request* r = add_request(SMOKE, d.pos, d.radius, importance);
+        r->smoke = d;
+    }
+
+    void create_solid_particles( const solids_desc& d, float importance = 1.0f ) {
+        request* r = add_request(SOLIDS, d.pos, d.emitter_radius, importance);
+        r->solids = d;
+    }
+
+    void launch_combo( const combo_desc& d, float importance = 1.0f ) {
+        request* r = add_request(COMBO, d.pos, d.emitter_radius, importance);
+        r->combo = d;
+    }
+
+    void flash( const flash_desc& d, float importance = 1.0f ) {
+        request* r = add_request(FLASH, d.pos, d.range * 0.1f, importance);
+        r->flash = d;
+    }
+    //@}
+
+    ///Process queued requests, call once per frame
+    //@param camera camera position for distance culling and scoring
+    //@param dt time step since the last commit
+    void commit( const double3& camera, float dt )
+    {
+        _time += dt;
+        _stats = stats();
+        _stats.requested = uint(_requests.size());
+
+        expire();
+
+        const double maxd2 = double(_params.max_distance) * _params.max_distance;
+
+        //cull and score
+        for (uint i = 0; i < _requests.size(); ++i)
+        {
+            request& r = _requests[i];
+            double d2 = glm::length_squared(r.pos - camera);
+            if (d2 > maxd2) {
+                r.kind = NONE;
+                ++_stats.culled_distance;
+                continue;
+            }
+
+            r.score = score(r.importance, r.radius, d2);
+            r.cell = cell_key(r.pos);
+        }
+
+        merge(camera);
+
+        //highest scores first
+        _order.reset();
+        for (uint i = 0; i < _requests.size(); ++i)
+            if (_requests[i].kind != NONE)
+                *_order.add() = i;
+
+        std::sort(_order.ptr(), _order.ptr() + _order.size(), [this](uint a, uint b) {
+            return _requests[a].score > _requests[b].score;
+        });
+
+        uint ncombos = 0, nflashes = 0;
+
+        for (uint i = 0; i < _order.size(); ++i)
+        {
+            request& r = _requests[_order[i]];
+
+            switch (r.kind) {
+            case SMOKE:
+            case SOLIDS:
+                if (make_room(r, camera))
+                    create(r);
+                else
+                    ++_stats.culled_budget;
+                break;
+
+            case COMBO:
+                if (ncombos++ < _params.max_combos) {
+                    const combo_desc& c = r.combo;
+                    _exp->launch_combo(c.pos, c.speed, c.size, c.color, c.smoke_color,
+                        c.emitter_radius, c.emitter_speed, c.particle_size, c.smoke_timeout,
+                        c.crater, c.solids, c.smoke);
+                    ++_stats.combos;
+                }
+                else
+                    ++_stats.culled_budget;
+                break;
+
+            case FLASH:
+                if (nflashes++ < _params.max_flashes) {
+                    const flash_desc& f = r.flash;
+                    _exp->flash(f.pos, f.intensity, f.color, f.range, f.timeout);
+                    ++_stats.flashes;
+                }
+                else
+                    ++_stats.culled_budget;
+                break;
+            }
+        }
+
+        _requests.reset();
+
+        _stats.live_smoke = _live[SMOKE];
+        _stats.live_solids = _live[SOLIDS];
+    }
+
+    ///Destroy all live emitters and drop pending requests
+    void reset()
+    {
+        for (uint i = 0; i < _emitters.size(); ++i)
+            destroy(_emitters[i]);
+
+        _emitters.reset();
+        _requests.reset();
+        _live[SMOKE] = _live[SOLIDS] = 0;
+    }
+
+private:
+
+    enum EKind : uint8 {
+        NONE,
+        SMOKE,
+        SOLIDS,
+        COMBO,
+        FLASH,
+    };
+
+    struct request
+    {
+        double3 pos;
+        float radius;
+        float importance;
+        float score;
+        uint64 cell;
+        EKind kind;
+
+        union {
+            smoke_desc smoke;
+            solids_desc solids;
+            combo_desc combo;
+            flash_desc flash;
+        };
+
+        request() {}
+    };
+
+    ///Live host emitter
+    struct emitter
+    {
+        double3 pos;
+        uint64 cell;
+        double expire;
+        float score;                        //< importance and size, without the distance term
+        uint id;                            //< host emitter id
+        EKind kind;
+    };
+
+    request* add_request( EKind kind, const double3& pos, float radius, float importance )
+    {
+        request* r = _requests.add();
+        r->pos = pos;
+        r->radius = radius;
+        r->importance = importance;
+        r->score = 0;
+        r->cell = 0;
+        r->kind = kind;
+        return r;
+    }
+
+    static float score( float importance, float radius, double d2 ) {
+        //projected size weighted by importance, 1m bias to avoid the singularity at the camera
+        return importance * radius / float(sqrt(d2) + 1.0);
+    }
+
+    uint64 cell_key( const double3& pos ) const
+    {
+        int hv[2];
+        int face = xyz_to_cubeface(&pos.x, hv);
+        return spherecoord(face, hv[0], hv[1], _params.cell_level);
+    }
+
+    ///Merge close requests of the same kind in the same cell
+    void merge( const double3& camera )
+    {
+        const double md = _params.merge_distance;
+        const double md2 = md * md;
+
+        //group by cell and kind, sorted along x for the sweep
+        _order.reset();
+        for (uint i = 0; i < _requests.size(); ++i) {
+            EKind k = _requests[i].kind;
+            if (k == SMOKE || k == SOLIDS)
+                *_order.add() = i;
+        }
+
+        std::sort(_order.ptr(), _order.ptr() + _order.size(), [this](uint a, uint b) {
+            const request& ra = _requests[a];
+            const request& rb = _requests[b];
+            if (ra.cell != rb.cell)
+                return ra.cell < rb.cell;
+            if (ra.kind != rb.kind)
+                return ra.kind < rb.kind;
+            return ra.pos.x < rb.pos.x;
+        });
+
+        uint n = uint(_order.size());
+        for (uint i = 0; i < n; )
+        {
+            const request& first = _requests[_order[i]];
+            uint end = i + 1;
+            while (end < n && _requests[_order[end]].cell == first.cell && _requests[_order[end]].kind == first.kind)
+                ++end;
+
+            for (uint a = i; a < end; ++a) {
+                request& ra = _requests[_order[a]];
+                if (ra.kind == NONE)
+                    continue;
+
+                const double x0 = ra.pos.x;
+                bool merged = false;
+                uint tested = 0;
+
+                for (uint b = a + 1; b < end && tested < _params.merge_candidates; ++b) {
+                    request& rb = _requests[_order[b]];
+                    //sorted by x, nothing further can be within the distance
+                    if (rb.pos.x - x0 > md)
+                        break;
+                    if (rb.kind == NONE)
+                        continue;
+
+                    ++tested;
+                    if (glm::length_squared(rb.pos - ra.pos) > md2)
+                        continue;
+
+                    merge_into(ra, rb);
+                    rb.kind = NONE;
+                    merged = true;
+                    ++_stats.merged;
+                }
+
+                //the merged emitter is larger and moved
+                if (merged)
+                    ra.score = score(ra.importance, ra.radius, glm::length_squared(ra.pos - camera));
+            }
+
+            i = end;
+        }
+    }
+
+    ///Merge request b into a, preserving the total emitter volume
+    static void merge_into( request& a, const request& b )
+    {
+        float va = a.radius * a.radius * a.radius;
+        float vb = b.radius * b.radius * b.radius;
+        float w = vb / (va + vb);
+        float r = cbrtf(va + vb);
+
+        a.pos += (b.pos - a.pos) * double(w);
+        a.radius = r;
+        a.importance = glm::max(a.importance, b.importance);
+
+        if (a.kind == SMOKE) {
+            smoke_desc& s = a.smoke;
+            s.pos = a.pos;
+            s.radius = r;
+            s.norm = glm::normalize0(s.norm + b.smoke.norm);
+            s.density = glm::max(s.density, b.smoke.density);
+            s.speed = glm::max(s.speed, b.smoke.speed);
+            s.fade_time = glm::max(s.fade_time, b.smoke.fade_time);
+            s.timeout = glm::max(s.timeout, b.smoke.timeout);
+            s.color = glm::mix(s.color, b.smoke.color, w);
+        }
+        else {
+            solids_desc& s = a.solids;
+            s.pos = a.pos;
+            s.emitter_radius = r;
+            s.norm = glm::normalize0(s.norm + b.solids.norm);
+            s.particle_radius = glm::max(s.particle_radius, b.solids.particle_radius);
+            s.speed = glm::max(s.speed, b.solids.speed);
+            s.highlight = glm::max(s.highlight, b.solids.highlight);
+        }
+    }
+
+    ///Make room for a new emitter, evicting lower scoring live emitters if needed
+    //@return false if the request does not fit the budget
+    bool make_room( const request& r, const double3& camera )
+    {
+        uint cap = r.kind == SMOKE ? _params.max_smoke : _params.max_solids;
+
+        uint incell = 0;
+        int weakest_cell = -1, weakest = -1;
+        float sc_cell = r.score, sc = r.score;
+
+        for (uint i = 0; i < _emitters.size(); ++i)
+        {
+            const emitter& e = _emitters[i];
+            if (e.kind != r.kind)
+                continue;
+
+            float s = e.score / float(glm::length(e.pos - camera) + 1.0);
+            if (s < sc) {
+                sc = s;
+                weakest = i;
+            }
+            if (e.cell == r.cell) {
+                ++incell;
+                if (s < sc_cell) {
+                    sc_cell = s;
+                    weakest_cell = i;
+                }
+            }
+        }
+
+        if (incell >= _params.max_per_cell) {
+            if (weakest_cell < 0)
+                return false;
+            evict(weakest_cell);
+        }
+        else if (_live[r.kind] >= cap) {
+            if (weakest < 0)
+                return false;
+            evict(weakest);
+        }
+
+        return true;
+    }
+
+    void create( const request& r )
+    {
+        uint reuse = UMAX32;
+        coid::dynarray<uint>& pool = r.kind == SMOKE ? _free_smoke : _free_solids;
+        if (pool.size()) {
+            reuse = pool.last();
+            pool.resize(pool.size() - 1);
+        }
+
+        emitter* e = _emitters.add();
+        e->pos = r.pos;
+        e->cell = r.cell;
+        e->score = r.importance * r.radius;
+        e->kind = r.kind;
+
+        if (r.kind == SMOKE) {
+            const smoke_desc& s = r.smoke;
+            e->id = _exp->create_smoke(s.pos, s.norm, s.radius, s.speed, s.density,
+                s.fade_time, s.timeout, s.color, s.age, reuse);
+            e->expire = _time + s.timeout + s.fade_time - s.age;
+        }
+        else {
+            const solids_desc& s = r.solids;
+            e->id = _exp->create_solid_particles(s.pos, s.norm, s.emitter_radius, s.particle_radius,
+                s.speed, s.spread, s.highlight, s.age, s.bcolor, s.hcolor, reuse);
+            e->expire = _time + _params.solids_lifetime - s.age;
+        }
+
+        ++_live[r.kind];
+        ++_stats.created;
+    }
+
+    ///Retire emitters past their lifetime, their ids go to the free lists
+    void expire()
+    {
+        for (uint i = uint(_emitters.size()); i-- > 0; ) {
+            if (_emitters[i].expire <= _time)
+                retire(i);
+        }
+    }
+
+    void evict( uint i )
+    {
+        destroy(_emitters[i]);
+        retire(i);
+        ++_stats.evicted;
+    }
+
+    void destroy( const emitter& e )
+    {
+        if (e.kind == SMOKE)
+            _exp->destroy_smoke(e.id);
+        else
+            _exp->destroy_solid_particles(e.id);
+    }
+
+    void retire( uint i )
+    {
+        const emitter& e = _emitters[i];
+        *(e.kind == SMOKE ? _free_smoke : _free_solids).add() = e.id;
+        --_live[e.kind];
+
+        uint last = uint(_emitters.size()) - 1;
+        if (i != last)
+            _emitters[i] = _emitters[last];
+        _emitters.resize(last);
+    }
+
+private:
+
+    iref<explosions> _exp;
+    params _params;
+
+    coid::dynarray<request> _requests;      //< requests queued in the current frame
+    coid::dynarray<uint> _order;            //< request index scratch
+    coid::dynarray<emitter> _emitters;      //< live smoke and solid particle emitters
+
+    coid::dynarray<uint> _free_smoke;       //< recyclable host smoke ids
+    coid::dynarray<uint> _free_solids;      //< recyclable host solid particle ids
+
+    uint _live[3] = { 0, 0, 0 };            //< live emitters by EKind (SMOKE, SOLIDS)
+    double _time = 0;
+    stats _stats;
+};
+
+} //namespace ot
+
+#endif //__OT_EMITTER_BUDGET_H__
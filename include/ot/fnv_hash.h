@@ -0,0 +1,34 @@
+#pragma once
+#ifndef __OT_FNV_HASH_H__
+#define __OT_FNV_HASH_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+
+/**
+    64-bit FNV-1a hash, used for the cache keys of the plugin-side helpers
+    (text layouts, pooled object urls, SDM mesh cache files).
+
+    Example:
+        uint64 h = ot::fnv1a(&font, sizeof(font));
+        h = ot::fnv1a(text.ptr(), text.len(), h);
+**/
+
+namespace ot {
+
+static constexpr uint64 FNV1A_BASIS = 14695981039346656037ULL;
+
+///Hash a byte range
+//@param h hash to continue from, FNV1A_BASIS to start a new one
+inline uint64 fnv1a( const void* p, uints n, uint64 h = FNV1A_BASIS )
+{
+    const uint8* b = (const uint8*)p;
+    for (uints i = 0; i < n; ++i)
+        h = (h ^ b[i]) * 1099511628211ULL;
+    return h;
+}
+
+} //namespace ot
+
+#endif //__OT_FNV_HASH_H__
@@ -0,0 +1,219 @@
+#pragma once
+#ifndef __OT_GEOMOB_SPAWNER_H__
+#define __OT_GEOMOB_SPAWNER_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+
+#include "geomob.h"
+#include "glm/glm_ext.h"
+
+/**
+    Batch geomob creation with a completion queue.
+
+    create_many() spawns a whole set of instances of one model (a forest of
+    props, a convoy) in one call, through the geomob::create2 creator.
+    Instances are then tracked until they report is_ready(), and reported
+    through a completion queue fetched once per frame, tagged with the
+    caller's ids. Instances that don't become ready within the timeout are
+    removed from the scene and reported as failed.
+
+    The readiness of pending instances is checked round robin with a
+    bounded number of is_ready() calls per update(), so thousands of
+    pending spawns don't cost thousands of calls per frame.
+
+    Example:
+        ot::geomob_spawner spawner;
+
+        uint first = spawner.create_many("outerra/tree/pine"_T, pos.ptr(), rot.ptr(), pos.size());
+
+        //each frame
+        spawner.update(dt);
+        spawner.fetch(done);
+        for (const ot::geomob_spawner::completion& c : done)
+            if (c.result == ot::geomob_spawner::READY)
+                props[c.tag - first] = c.obj;
+**/
+
+namespace ot {
+
+////////////////////////////////////////////////////////////////////////////////
+class geomob_spawner
+{
+public:
+
+    enum EResult : uint8 {
+        READY,                          //< instance is loaded and ready
+        FAILED,                         //< instance could not be created or timed out
+    };
+
+    struct completion
+    {
+        uint tag;                       //< caller id of the spawn
+        EResult result;
+        iref<geomob> obj;               //< the instance, null if failed
+    };
+
+    ///Spawner configuration
+    struct params
+    {
+        uint poll_budget = 256;         //< max is_ready() calls per update()
+        float timeout = 30.0f;          //< time after which a pending instance fails [s]
+    };
+
+    ///Counters, cumulative except pending
+    struct stats
+    {
+        uint64 spawned = 0;             //< instances created
+        uint64 ready = 0;               //< instances reported ready
+        uint64 failed = 0;              //< instances failed or timed out
+        uint64 polls = 0;               //< is_ready() calls made
+        uint pending = 0;               //< instances waiting to become ready
+    };
+
+    geomob_spawner()
+        : geomob_spawner(params())
+    {}
+
+    explicit geomob_spawner( const params& p )
+        : _params(p)
+    {}
+
+    params& get_params() { return _params; }
+
+    ///Spawn n instances of a model
+    //@param url geom URL like "outerra/m4/m4"
+    //@param pos n positions
+    //@param rot n rotations, or null for identity
+    //@param parent_entity_id parent entity, or invalid handle for root objects
+    //@param parent_joint_id parent's joint id or 0xffff
+    //@return tag of the first instance, the following ones are numbered consecutively
+    uint create_many( const coid::token& url, const double3* pos, const quat* rot, uint n,
+        entity_handle parent_entity_id = entity_handle(), uint parent_joint_id = 0xffff )
+    {
+        uint tag0 = _next_tag;
+        _next_tag += n;
+
+        const quat qid(1, 0, 0, 0);
+        pending* p = _pending.add(n);
+        uint np = 0;
+
+        for (uint i = 0; i < n; ++i)
+        {
+            iref<geomob> g = geomob::create2(url, parent_entity_id, parent_joint_id,
+                pos[i], rot ? rot[i] : qid);
+
+            if (!g) {
+                complete(tag0 + i, FAILED, 0);
+                continue;
+            }
+
+            pending& pp = p[np++];
+            pp.tag = tag0 + i;
+            pp.age = 0;
+            pp.obj = g;
+        }
+
+        _pending.resize(_pending.size() - (n - np));
+        _stats.spawned += np;
+        _stats.pending = uint(_pending.size());
+        return tag0;
+    }
+
+    ///Check pending instances, call once per frame
+    //@param dt time step [s]
+    void update( float dt )
+    {
+        uint n = uint(_pending.size());
+        uint budget = glm::min(_params.poll_budget, n);
+
+        for (uint i = 0; i < n; ++i)
+            _pending[i].age += dt;
+
+        for (; budget && n; --budget)
+        {
+            if (_cursor >= n)
+                _cursor = 0;
+
+            pending& p = _pending[_cursor];
+            ++_stats.polls;
+
+            if (p.obj->is_ready())
+                complete(p.tag, READY, p.obj);
+            else if (p.age > _params.timeout) {
+                p.obj->remove_from_scene();
+                complete(p.tag, FAILED, 0);
+            }
+            else {
+                ++_cursor;
+                continue;
+            }
+
+            //swap-remove, the swapped in item is checked next
+            if (_cursor + 1 < n)
+                _pending[_cursor] = _pending[n - 1];
+            _pending.resize(--n);
+        }
+
+        _stats.pending = n;
+    }
+
+    ///Fetch completions since the last fetch
+    //@param out [out] swapped with the internal completion queue
+    void fetch( coid::dynarray<completion>& out )
+    {
+        out.reset();
+        out.swap(_done);
+    }
+
+    ///Remove all pending instances from the scene, without completions
+    void cancel()
+    {
+        for (uint i = 0, n = uint(_pending.size()); i < n; ++i)
+            _pending[i].obj->remove_from_scene();
+        _pending.reset();
+        _stats.pending = 0;
+    }
+
+    const stats& get_stats() const { return _stats; }
+
+private:
+
+    struct pending
+    {
+        uint tag;
+        float age;
+        iref<geomob> obj;
+    };
+
+    void complete( uint tag, EResult r, const iref<geomob>& obj )
+    {
+        completion* c = _done.add();
+        c->tag = tag;
+        c->result = r;
+        c->obj = obj;
+
+        if (r == READY)
+            ++_stats.ready;
+        else
+            ++_stats.failed;
+    }
+
+private:
+
+    params _params;
+
+    coid::dynarray<pending> _pending;
+    coid::dynarray<completion> _done;
+    uint _cursor = 0;
+    uint _next_tag = 0;
+
+    stats _stats;
+};
+
+} //namespace ot
+
+#endif //__OT_GEOMOB_SPAWNER_H__
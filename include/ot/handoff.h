@@ -0,0 +1,279 @@
+#pragma once
+#ifndef __OT_HANDOFF_H__
+#define __OT_HANDOFF_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+
+#include <atomic>
+
+/**
+    Lock-free data handoff between engine threads and plugin threads.
+
+    Plugin callbacks like update, update_frame, process_frame or on_user_key
+    run on different engine threads. Instead of guarding the shared state
+    with a comm_mutex (as the share_lock() pattern of the interfaces does),
+    data can be passed through:
+        - spsc_ring: bounded single producer/single consumer queue, each side
+          keeps a cached copy of the other side's index, so the shared cache
+          lines are touched only when the cached view runs out
+        - mpsc_ring: bounded multiple producer/single consumer queue with
+          per-slot sequence numbers, producers claim slots with a CAS
+        - triple_buffer: latest-value handoff, the writer never blocks and
+          the reader always gets the most recent complete value
+
+    The indices of each side are padded to separate cache lines. Capacities
+    must be powers of two.
+
+    Example:
+        ot::spsc_ring<key_event, 256> _keys;
+
+        //engine thread
+        void on_user_key( ... ) override {
+            _keys.push(ev);
+        }
+
+        //plugin thread
+        _keys.drain([&](const key_event& ev) { handle(ev); });
+
+
+        ot::triple_buffer<frame_state> _state;
+
+        //producer
+        _state.back() = state;
+        _state.publish();
+
+        //consumer
+        if (_state.update())
+            use(_state.front());
+**/
+
+namespace ot {
+
+enum { HANDOFF_CACHE_LINE = 64 };
+
+////////////////////////////////////////////////////////////////////////////////
+///Bounded single producer/single consumer ring
+template <class T, uint N>
+class spsc_ring
+{
+    static_assert(N && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+public:
+
+    ///Push an item, producer thread only
+    //@return false if the ring is full
+    bool push( const T& v )
+    {
+        uint head = _head.load(std::memory_order_relaxed);
+        if (head - _tail_cache >= N) {
+            _tail_cache = _tail.load(std::memory_order_acquire);
+            if (head - _tail_cache >= N)
+                return false;
+        }
+
+        _data[head & (N - 1)] = v;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    ///Pop an item, consumer thread only
+    //@return false if the ring is empty
+    bool pop( T& v )
+    {
+        uint tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head_cache) {
+            _head_cache = _head.load(std::memory_order_acquire);
+            if (tail == _head_cache)
+                return false;
+        }
+
+        v = _data[tail & (N - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    ///Consume all available items, consumer thread only
+    //@param fn functor called as fn(const T&)
+    //@return number of items consumed
+    template <class Fn>
+    uint drain( Fn fn )
+    {
+        uint tail = _tail.load(std::memory_order_relaxed);
+        uint head = _head_cache = _head.load(std::memory_order_acquire);
+
+        for (uint i = tail; i != head; ++i)
+            fn(const_cast<const T&>(_data[i & (N - 1)]));
+
+        _tail.store(head, std::memory_order_release);
+        return head - tail;
+    }
+
+    //@return approximate number of queued items
+    uint size() const {
+        return _head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_relaxed);
+    }
+
+    static constexpr uint capacity() { return N; }
+
+private:
+
+    alignas(HANDOFF_CACHE_LINE) std::atomic<uint> _head = { 0 };
+    uint _tail_cache = 0;               //< producer's view of _tail
+
+    alignas(HANDOFF_CACHE_LINE) std::atomic<uint> _tail = { 0 };
+    uint _head_cache = 0;               //< consumer's view of _head
+
+    alignas(HANDOFF_CACHE_LINE) T _data[N];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///Bounded multiple producer/single consumer ring
+template <class T, uint N>
+class mpsc_ring
+{
+    static_assert(N && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+public:
+
+    mpsc_ring() {
+        for (uint i = 0; i < N; ++i)
+            _cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    ///Push an item, any thread
+    //@return false if the ring is full
+    bool push( const T& v )
+    {
+        uint pos = _head.load(std::memory_order_relaxed);
+        cell* c;
+
+        for (;;) {
+            c = &_cells[pos & (N - 1)];
+            uint seq = c->seq.load(std::memory_order_acquire);
+            int dif = int(seq - pos);
+
+            if (dif == 0) {
+                if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+                return false;
+            else
+                pos = _head.load(std::memory_order_relaxed);
+        }
+
+        c->data = v;
+        c->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    ///Pop an item, consumer thread only
+    //@return false if the ring is empty or the next item is still being written
+    bool pop( T& v )
+    {
+        cell& c = _cells[_tail & (N - 1)];
+        if (c.seq.load(std::memory_order_acquire) != _tail + 1)
+            return false;
+
+        v = c.data;
+        c.seq.store(_tail + N, std::memory_order_release);
+        ++_tail;
+        return true;
+    }
+
+    ///Consume all available items, consumer thread only
+    //@param fn functor called as fn(const T&)
+    //@return number of items consumed
+    template <class Fn>
+    uint drain( Fn fn )
+    {
+        uint n = 0;
+        for (;; ++n) {
+            cell& c = _cells[_tail & (N - 1)];
+            if (c.seq.load(std::memory_order_acquire) != _tail + 1)
+                break;
+
+            fn(const_cast<const T&>(c.data));
+            c.seq.store(_tail + N, std::memory_order_release);
+            ++_tail;
+        }
+        return n;
+    }
+
+    static constexpr uint capacity() { return N; }
+
+private:
+
+    struct cell
+    {
+        std::atomic<uint> seq;
+        T data;
+    };
+
+    alignas(HANDOFF_CACHE_LINE) std::atomic<uint> _head = { 0 };
+    alignas(HANDOFF_CACHE_LINE) uint _tail = 0;     //< consumer only
+    alignas(HANDOFF_CACHE_LINE) cell _cells[N];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///Latest-value handoff between a single writer and a single reader
+template <class T>
+class triple_buffer
+{
+public:
+
+    triple_buffer()
+        : _mid(1)
+    {}
+
+    ///Buffer to write the next value into, writer thread only
+    T& back() { return _slots[_back].value; }
+
+    ///Publish the back buffer, writer thread only
+    void publish()
+    {
+        uint old = _mid.exchange(_back | DIRTY, std::memory_order_acq_rel);
+        _back = old & INDEX;
+    }
+
+    ///Take the most recently published value, reader thread only
+    //@return true if a new value was published since the last update
+    bool update()
+    {
+        if (!(_mid.load(std::memory_order_relaxed) & DIRTY))
+            return false;
+
+        uint old = _mid.exchange(_front, std::memory_order_acq_rel);
+        _front = old & INDEX;
+        return true;
+    }
+
+    ///Current value, reader thread only
+    const T& front() const { return _slots[_front].value; }
+    T& front() { return _slots[_front].value; }
+
+private:
+
+    enum : uint {
+        INDEX = 3,
+        DIRTY = 4,                      //< middle buffer holds an unread value
+    };
+
+    struct alignas(HANDOFF_CACHE_LINE) slot
+    {
+        T value;
+    };
+
+    slot _slots[3];
+
+    alignas(HANDOFF_CACHE_LINE) uint _back = 0;     //< writer only
+    alignas(HANDOFF_CACHE_LINE) std::atomic<uint> _mid;
+    alignas(HANDOFF_CACHE_LINE) uint _front = 2;    //< reader only
+};
+
+} //namespace ot
+
+#endif //__OT_HANDOFF_H__
@@ -0,0 +1,510 @@
+#pragma once
+#ifndef __OT_I420_RECORDER_H__
+#define __OT_I420_RECORDER_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+#include <comm/str.h>
+#include <comm/sync/mutex.h>
+
+#include <immintrin.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#ifdef _WIN32
+#include <malloc.h>
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#define OT_I420_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#define OT_I420_NOMINMAX
+#endif
+#include <windows.h>
+#ifdef OT_I420_LEAN_AND_MEAN
+#undef WIN32_LEAN_AND_MEAN
+#undef OT_I420_LEAN_AND_MEAN
+#endif
+#ifdef OT_I420_NOMINMAX
+#undef NOMINMAX
+#undef OT_I420_NOMINMAX
+#endif
+#else
+#include <sys/mman.h>
+#endif
+
+#include "video_recorder.h"
+
+/**
+    Reference video_recorder client with a multithreaded I420 pipeline.
+
+    process_frame() runs on the render thread and only copies the frame into
+    a ring of preallocated, page-locked buffers, then returns. Worker threads
+    pick up the frames, convert the Y-U-Y-V row interleaved layout into
+    planar I420 with non-temporal SSE copies, and pass them to an i420_sink
+    in frame order.
+
+    When the ring is full the frame is dropped, and its nbatchframes is
+    carried over to the next accepted frame so that the sink still sees the
+    correct number of frames elapsed. The final frame (video_end) is never
+    dropped, process_frame waits for a free buffer instead.
+
+    Buffers that could not be page-locked (mlock/VirtualLock failing, e.g.
+    over RLIMIT_MEMLOCK or the process working set) are still used and
+    counted in stats::unlocked_buffers; the copy may then page fault.
+
+    Example:
+        class my_sink : public ot::i420_sink { ... };
+
+        iref<ot::i420_recorder> rec = ot::video_recorder::create(new ot::i420_recorder(new my_sink));
+        rec->record(true);
+        ...
+        ot::i420_recorder::stats st = rec->get_stats();
+**/
+
+namespace ot {
+
+///Planar I420 frame passed to sinks
+struct i420_frame
+{
+    const uint8* y;
+    const uint8* u;
+    const uint8* v;
+    uint width;                         //< luma width
+    uint height;                        //< luma height
+    uint cwidth;                        //< chroma width
+    uint cheight;                       //< chroma height
+    uint ystride;                       //< luma row stride in bytes
+    uint cstride;                       //< chroma row stride in bytes
+    uint64 timestamp_ns;                //< frame render time
+    uint nbatchframes;                  //< 1 + number of frames skipped before this one
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///Consumer of converted frames, called from the worker threads in frame order
+class i420_sink
+{
+public:
+    virtual ~i420_sink() {}
+
+    ///Start of the recording
+    //@return false if the sink could not be opened
+    virtual bool open( const coid::token& video_folder, uint width, uint height ) = 0;
+
+    virtual void write( const i420_frame& frame ) = 0;
+
+    ///End of the recording
+    virtual void close() = 0;
+};
+
+///Writes raw planar I420 frames into a file in the video folder
+class i420_file_sink : public i420_sink
+{
+public:
+    ~i420_file_sink() { close(); }
+
+    bool open( const coid::token& video_folder, uint width, uint height ) override
+    {
+        close();
+
+        coid::charstr path = video_folder;
+        path << "/capture_" << width << 'x' << height << ".i420";
+        _file = fopen(path.c_str(), "wb");
+        return _file != 0;
+    }
+
+    void write( const i420_frame& f ) override
+    {
+        if (!_file)
+            return;
+        write_plane(f.y, f.width, f.height, f.ystride);
+        write_plane(f.u, f.cwidth, f.cheight, f.cstride);
+        write_plane(f.v, f.cwidth, f.cheight, f.cstride);
+    }
+
+    void close() override
+    {
+        if (_file) {
+            fclose(_file);
+            _file = 0;
+        }
+    }
+
+private:
+
+    void write_plane( const uint8* p, uint w, uint h, uint stride ) {
+        for (uint r = 0; r < h; ++r, p += stride)
+            fwrite(p, 1, w, _file);
+    }
+
+    FILE* _file = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class i420_recorder : public video_recorder
+{
+public:
+
+    ///Pipeline counters
+    struct stats
+    {
+        uint queue_depth = 0;           //< frames waiting or in conversion
+        uint max_queue_depth = 0;
+        uint64 frames = 0;              //< frames written to the sink
+        uint64 dropped = 0;             //< frames dropped because the ring was full
+        uint64 latency_ns = 0;          //< last frame latency from process_frame to the sink
+        uint64 max_latency_ns = 0;
+        uint64 total_latency_ns = 0;    //< sum of latencies, divide by frames for the average
+        uint unlocked_buffers = 0;      //< frame buffers that could not be page-locked
+    };
+
+    //@param sink frame consumer, owned by the recorder; raw file sink if null
+    //@param nbuffers number of frame buffers in the ring
+    //@param nworkers number of conversion threads
+    explicit i420_recorder( i420_sink* sink = 0, uint nbuffers = 8, uint nworkers = 2 )
+        : _sink(sink ? sink : new i420_file_sink)
+        , _nworkers(nworkers ? nworkers : 1)
+        , _mx(500, false)
+    {
+        _slots.resize(nbuffers ? nbuffers : 1);
+        for (uint i = 0; i < _slots.size(); ++i) {
+            _slots[i].data = 0;
+            _slots[i].locked = false;
+        }
+    }
+
+    ~i420_recorder()
+    {
+        stop_workers();
+        free_buffers();
+        delete _sink;
+    }
+
+    stats get_stats() const
+    {
+        std::lock_guard<coid::comm_mutex> lock(_mx);
+        stats s = _stats;
+        s.queue_depth = uint(_queued - _written);
+        return s;
+    }
+
+protected:
+
+    bool initialize( const coid::token& video_folder, int width, int height ) override
+    {
+        //let the previous recording drain before touching the buffers
+        wait_idle();
+
+        _width = uint(width);
+        _height = uint(height);
+        _w4 = (_width + 3) & ~3U;
+        _u4 = (_width / 2 + 3) & ~3U;
+        _h2 = (_height + 1) & ~1U;
+        _cwidth = _width / 2;
+        _cheight = _h2 / 2;
+        _frame_size = uints(_h2 / 2) * (2 * _w4 + 2 * _u4);
+
+        if (!alloc_buffers(_frame_size)) {
+            free_buffers();
+            _frame_size = 0;
+            return false;
+        }
+
+        if (!_sink->open(video_folder, _width, _height)) {
+            free_buffers();
+            _frame_size = 0;
+            return false;
+        }
+
+        _carry = 0;
+        start_workers();
+        return true;
+    }
+
+    void process_frame( const void* data, uints size, uint64 timestamp_ns, uint nbatchframes, bool video_end ) override
+    {
+        if (!_frame_size)
+            return;
+
+        const uint nslots = uint(_slots.size());
+
+        {
+            std::unique_lock<coid::comm_mutex> lock(_mx);
+            if (_queued - _written >= nslots) {
+                if (!video_end) {
+                    //ring full, drop and account the frame in the next one
+                    _carry += nbatchframes;
+                    ++_stats.dropped;
+                    return;
+                }
+                _cv.wait(lock, [this, nslots]() { return _queued - _written < nslots; });
+            }
+        }
+
+        //the slot is not touched by the workers until _queued is advanced
+        slot& s = _slots[uint(_queued % nslots)];
+        uints n = size < _frame_size ? size : _frame_size;
+        ::memcpy(s.data, data, n);
+        s.timestamp_ns = timestamp_ns;
+        s.nbatchframes = nbatchframes + _carry;
+        s.end = video_end;
+        s.submit_ns = now_ns();
+        _carry = 0;
+
+        {
+            std::lock_guard<coid::comm_mutex> lock(_mx);
+            ++_queued;
+            uint depth = uint(_queued - _written);
+            if (depth > _stats.max_queue_depth)
+                _stats.max_queue_depth = depth;
+        }
+        _cv.notify_all();
+    }
+
+private:
+
+    struct slot
+    {
+        uint8* data;                    //< interleaved frame data
+        uint64 timestamp_ns;
+        uint64 submit_ns;
+        uint nbatchframes;
+        bool end;
+        bool locked;                    //< data is page-locked
+    };
+
+    static uint64 now_ns() {
+        return uint64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    ///Copy row with non-temporal stores, dst must be 16B aligned
+    static void copy_row_nt( uint8* dst, const uint8* src, uint n )
+    {
+        uint i = 0;
+        for (; i + 64 <= n; i += 64) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(src + i + 16));
+            __m128i c = _mm_loadu_si128((const __m128i*)(src + i + 32));
+            __m128i d = _mm_loadu_si128((const __m128i*)(src + i + 48));
+            _mm_stream_si128((__m128i*)(dst + i), a);
+            _mm_stream_si128((__m128i*)(dst + i + 16), b);
+            _mm_stream_si128((__m128i*)(dst + i + 32), c);
+            _mm_stream_si128((__m128i*)(dst + i + 48), d);
+        }
+        for (; i + 16 <= n; i += 16)
+            _mm_stream_si128((__m128i*)(dst + i), _mm_loadu_si128((const __m128i*)(src + i)));
+        if (i < n)
+            ::memcpy(dst + i, src + i, n - i);
+    }
+
+    ///De-interleave Y-U-Y-V rows into planar I420
+    //@note plane strides are rounded to 16 bytes for aligned streaming stores
+    void convert( const uint8* src, uint8* planes ) const
+    {
+        const uint ys = (_width + 15) & ~15U;
+        const uint cs = (_cwidth + 15) & ~15U;
+
+        uint8* y = planes;
+        uint8* u = y + uints(ys) * _h2;
+        uint8* v = u + uints(cs) * _cheight;
+
+        for (uint r = 0; r < _cheight; ++r)
+        {
+            copy_row_nt(y, src, _width);                    src += _w4;
+            copy_row_nt(u, src, _cwidth);                   src += _u4;
+            copy_row_nt(y + ys, src, _width);               src += _w4;
+            copy_row_nt(v, src, _cwidth);                   src += _u4;
+
+            y += 2 * ys;
+            u += cs;
+            v += cs;
+        }
+        _mm_sfence();
+    }
+
+    void worker()
+    {
+        coid::dynarray<uint8> planes;
+        const uint ys = (_width + 15) & ~15U;
+        const uint cs = (_cwidth + 15) & ~15U;
+        planes.resize(uints(ys) * _h2 + 2 * uints(cs) * _cheight + 16);
+        uint8* base = (uint8*)((uints(planes.ptr()) + 15) & ~uints(15));
+
+        const uint nslots = uint(_slots.size());
+        std::unique_lock<coid::comm_mutex> lock(_mx);
+
+        for (;;)
+        {
+            _cv.wait(lock, [this]() { return _taken < _queued || _quit; });
+            if (_taken >= _queued)
+                break;
+
+            uint64 seq = _taken++;
+            const slot& s = _slots[uint(seq % nslots)];
+            lock.unlock();
+
+            convert(s.data, base);
+
+            i420_frame f;
+            f.y = base;
+            f.u = base + uints(ys) * _h2;
+            f.v = f.u + uints(cs) * _cheight;
+            f.width = _width;
+            f.height = _height;
+            f.cwidth = _cwidth;
+            f.cheight = _cheight;
+            f.ystride = ys;
+            f.cstride = cs;
+            f.timestamp_ns = s.timestamp_ns;
+            f.nbatchframes = s.nbatchframes;
+
+            //sink writes in frame order
+            lock.lock();
+            _cv.wait(lock, [this, seq]() { return _written == seq; });
+            lock.unlock();
+
+            _sink->write(f);
+            if (s.end)
+                _sink->close();
+
+            uint64 lat = now_ns() - s.submit_ns;
+
+            lock.lock();
+            ++_written;
+            ++_stats.frames;
+            _stats.latency_ns = lat;
+            _stats.total_latency_ns += lat;
+            if (lat > _stats.max_latency_ns)
+                _stats.max_latency_ns = lat;
+            _cv.notify_all();
+        }
+    }
+
+    void start_workers()
+    {
+        if (_threads)
+            return;
+
+        _quit = false;
+        _threads = new std::thread[_nworkers];
+        for (uint i = 0; i < _nworkers; ++i)
+            _threads[i] = std::thread([this]() { worker(); });
+    }
+
+    void stop_workers()
+    {
+        {
+            std::lock_guard<coid::comm_mutex> lock(_mx);
+            _quit = true;
+        }
+        _cv.notify_all();
+
+        if (!_threads)
+            return;
+
+        for (uint i = 0; i < _nworkers; ++i)
+            _threads[i].join();
+
+        delete[] _threads;
+        _threads = 0;
+    }
+
+    void wait_idle()
+    {
+        std::unique_lock<coid::comm_mutex> lock(_mx);
+        _cv.wait(lock, [this]() { return _written == _queued; });
+    }
+
+    ///Allocate page-locked frame buffers
+    //@return false if the allocation failed, buffers that could not be locked are counted in stats
+    bool alloc_buffers( uints size )
+    {
+        //worker scratch depends on the frame geometry
+        stop_workers();
+        free_buffers();
+
+        _locked_size = size;
+
+        uint unlocked = 0;
+        for (uint i = 0; i < _slots.size(); ++i) {
+            bool locked;
+#ifdef _WIN32
+            uint8* p = (uint8*)_aligned_malloc(size, 4096);
+            if (!p)
+                return false;
+            locked = VirtualLock(p, size) != 0;
+#else
+            void* p = 0;
+            if (posix_memalign(&p, 4096, size) != 0)
+                return false;
+            locked = mlock(p, size) == 0;
+#endif
+            _slots[i].data = (uint8*)p;
+            _slots[i].locked = locked;
+            if (!locked)
+                ++unlocked;
+        }
+
+        std::lock_guard<coid::comm_mutex> lock(_mx);
+        _stats.unlocked_buffers = unlocked;
+        return true;
+    }
+
+    void free_buffers()
+    {
+        for (uint i = 0; i < _slots.size(); ++i) {
+            uint8* p = _slots[i].data;
+            if (!p)
+                continue;
+#ifdef _WIN32
+            if (_slots[i].locked)
+                VirtualUnlock(p, _locked_size);
+            _aligned_free(p);
+#else
+            if (_slots[i].locked)
+                munlock(p, _locked_size);
+            free(p);
+#endif
+            _slots[i].data = 0;
+        }
+    }
+
+private:
+
+    i420_sink* _sink;
+    uint _nworkers;
+
+    //frame geometry
+    uint _width = 0, _height = 0;
+    uint _w4 = 0, _u4 = 0, _h2 = 0;
+    uint _cwidth = 0, _cheight = 0;
+    uints _frame_size = 0;
+    uints _locked_size = 0;
+
+    coid::dynarray<slot> _slots;
+    std::thread* _threads = 0;
+
+    mutable coid::comm_mutex _mx;
+    std::condition_variable_any _cv;
+
+    uint64 _queued = 0;                 //< frames pushed by process_frame
+    uint64 _taken = 0;                  //< frames picked up by workers
+    uint64 _written = 0;                //< frames written to the sink, slots below are free
+    uint _carry = 0;                    //< nbatchframes of dropped frames
+    bool _quit = false;
+
+    stats _stats;
+};
+
+} //namespace ot
+
+#endif //__OT_I420_RECORDER_H__
@@ -0,0 +1,242 @@
+#pragma once
+#ifndef __OT_IGC_POSE_QUEUE_H__
+#define __OT_IGC_POSE_QUEUE_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+
+#include <atomic>
+
+#include "igc.h"
+#include "handoff.h"
+#include "glm/glm_ext.h"
+
+/**
+    Timestamped camera pose queue for igc::set_pos.
+
+    Poses received from an external host (typically on a network thread, at
+    a rate unrelated to the render rate) are pushed into a lock-free single
+    producer/single consumer ring. In igc::update() the queue is drained into
+    a short history and the camera pose is evaluated at the render time
+    minus a fixed delay:
+        - between two samples the position is interpolated linearly in
+          double precision ECEF and the rotation with glm::slerp
+        - past the newest sample the pose is extrapolated with the velocity
+          of the last two samples, for at most max_extrapolation seconds
+
+    The samples must be timestamped in the same time base as the time passed
+    to igc::update (the host clock offset can be folded into the delay).
+
+    Example:
+        class my_igc : public ot::igc
+        {
+            ot::igc_pose_queue _poses;
+
+            void update( double time ) override {
+                _poses.apply(*this, time);
+            }
+        };
+
+        //network receive thread
+        _poses.push(t, ecef, rot);
+**/
+
+namespace ot {
+
+////////////////////////////////////////////////////////////////////////////////
+class igc_pose_queue
+{
+public:
+
+    enum {
+        RING = 64,                      //< capacity of the producer ring
+        HISTORY = 8,                    //< samples kept for evaluation
+    };
+
+    ///Queue configuration
+    struct params
+    {
+        double delay = 0.05;            //< render time offset behind the newest samples [s]
+        double max_extrapolation = 0.2; //< max time to extrapolate past the newest sample [s]
+        double max_lead = 1.0;          //< samples further ahead of the render time are counted as early [s]
+    };
+
+    ///Counters, cumulative since construction
+    struct stats
+    {
+        uint64 received = 0;            //< samples taken from the ring
+        uint64 dropped = 0;             //< samples dropped on a full ring
+        uint64 late = 0;                //< samples arriving older than the render time
+        uint64 early = 0;               //< samples arriving more than max_lead ahead
+        uint64 out_of_order = 0;        //< samples older than the newest one, ignored
+        uint64 interpolated = 0;        //< frames evaluated between samples
+        uint64 extrapolated = 0;        //< frames evaluated past the newest sample
+        uint64 starved = 0;             //< frames that hit the extrapolation limit
+    };
+
+    igc_pose_queue()
+        : igc_pose_queue(params())
+    {}
+
+    explicit igc_pose_queue( const params& p )
+        : _params(p)
+    {}
+
+    params& get_params() { return _params; }
+
+    ///Push pose sample, producer thread only
+    //@return false if the ring was full and the sample was dropped
+    bool push( double time, const double3& ecef, const quat& rot )
+    {
+        sample s;
+        s.time = time;
+        s.pos = ecef;
+        s.rot = rot;
+
+        if (!_ring.push(s)) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    ///Drain the ring and evaluate the pose at the render time, consumer thread only
+    //@param time render frame time
+    //@return false if there are no samples yet
+    bool evaluate( double time, double3& pos, quat& rot )
+    {
+        double t = time - _params.delay;
+        drain(t);
+
+        if (!_count)
+            return false;
+
+        const sample& newest = hist(0);
+
+        //past the newest sample: extrapolate
+        if (t >= newest.time)
+        {
+            double dt = t - newest.time;
+            if (dt > _params.max_extrapolation) {
+                dt = _params.max_extrapolation;
+                ++_stats.starved;
+            }
+            ++_stats.extrapolated;
+
+            if (_count < 2) {
+                pos = newest.pos;
+                rot = newest.rot;
+                return true;
+            }
+
+            const sample& prev = hist(1);
+            double span = newest.time - prev.time;
+            double f = span > 0 ? dt / span : 0;
+
+            pos = newest.pos + (newest.pos - prev.pos) * f;
+
+            //angular velocity as the rotation between the last two samples
+            quat d = newest.rot * glm::conjugate(prev.rot);
+            if (d.w < 0)
+                d = -d;
+            rot = glm::normalize(glm::slerp(quat(1, 0, 0, 0), d, float(f)) * newest.rot);
+            return true;
+        }
+
+        //find the bracketing pair
+        for (uint k = 1; k < _count; ++k) {
+            const sample& a = hist(k);
+            if (a.time <= t) {
+                const sample& b = hist(k - 1);
+                double f = (t - a.time) / (b.time - a.time);
+                pos = a.pos + (b.pos - a.pos) * f;
+                rot = glm::slerp(a.rot, b.rot, float(f));
+                ++_stats.interpolated;
+                return true;
+            }
+        }
+
+        //older than the history
+        const sample& oldest = hist(_count - 1);
+        pos = oldest.pos;
+        rot = oldest.rot;
+        return true;
+    }
+
+    ///Evaluate and set the camera pose
+    //@return false if there are no samples yet
+    bool apply( igc& ig, double time )
+    {
+        double3 pos;
+        quat rot;
+        if (!evaluate(time, pos, rot))
+            return false;
+
+        ig.set_pos(pos, rot);
+        return true;
+    }
+
+    stats get_stats() const {
+        stats s = _stats;
+        s.dropped = _dropped.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+
+    struct sample
+    {
+        double time;
+        double3 pos;
+        quat rot;
+    };
+
+    //@return k-th newest sample of the history
+    const sample& hist( uint k ) const {
+        return _history[(_newest - k) & (HISTORY - 1)];
+    }
+
+    ///Move samples from the ring into the history
+    void drain( double t )
+    {
+        _ring.drain([&](const sample& s)
+        {
+            ++_stats.received;
+
+            if (_count && s.time <= hist(0).time) {
+                ++_stats.out_of_order;
+                return;
+            }
+
+            if (s.time < t)
+                ++_stats.late;
+            else if (s.time > t + _params.max_lead)
+                ++_stats.early;
+
+            _newest = (_newest + 1) & (HISTORY - 1);
+            _history[_newest] = s;
+            if (_count < HISTORY)
+                ++_count;
+        });
+    }
+
+private:
+
+    params _params;
+
+    spsc_ring<sample, RING> _ring;
+    std::atomic<uint64> _dropped = { 0 };
+
+    //consumer side
+    sample _history[HISTORY];
+    uint _newest = 0;
+    uint _count = 0;
+
+    stats _stats;
+};
+
+} //namespace ot
+
+#endif //__OT_IGC_POSE_QUEUE_H__
@@ -0,0 +1,303 @@
+#pragma once
+#ifndef __OT_IGC_QUERY_H__
+#define __OT_IGC_QUERY_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+#include <comm/sync/mutex.h>
+
+#include <mutex>
+
+#include "igc.h"
+#include "cubeface.h"
+#include "glm/glm_ext.h"
+
+/**
+    Batched asynchronous terrain query service for IGC hosts.
+
+    External simulations (CIGI-style) send height-above-terrain (HAT),
+    height-of-terrain (HOT) and line-of-sight (LOS) requests in batches.
+    Requests can be submitted from any thread; they are executed on the
+    next process() call, which must be made from igc::update(), where the
+    blocking igc::intersect is valid. Results are returned by request id.
+
+    HAT rays go down from pos and HOT rays down from the top of the terrain
+    range above pos; both only cover the elevation band between
+    min_elevation and max_elevation, so the number of segments follows the
+    altitude of the query and a query at any altitude can hit. HAT assumes
+    pos is above the terrain.
+
+    Long rays are split into segments of at most max_segment meters, as
+    igc::intersect works best with short rays. Segments are tested in order
+    until the first hit. The number of segments tested per frame is bounded
+    by segment_budget; unfinished requests keep their progress and continue
+    in the next frame, so a burst of requests never stalls a frame.
+
+    Example:
+        class my_igc : public ot::igc
+        {
+            ot::igc_query_service _queries;
+
+            void update( double time ) override {
+                _queries.process(*this);
+                _queries.fetch(results);            //send results to the host
+            }
+        };
+
+        //network thread
+        service.submit(requests, n);
+**/
+
+namespace ot {
+
+///Terrain query request
+struct igc_query
+{
+    enum EType : uint8 {
+        HAT,                            //< height of pos above terrain
+        HOT,                            //< terrain elevation at pos
+        LOS,                            //< first terrain hit between pos and to
+    };
+
+    uint id = 0;                        //< request id, returned with the result
+    EType type = LOS;
+    double3 pos;                        //< query position or LOS start
+    double3 to;                         //< LOS end
+};
+
+///Terrain query result
+struct igc_query_result
+{
+    uint id;                            //< request id
+    bool hit;                           //< terrain found
+    double distance;                    //< LOS: distance to the hit, HAT: height above terrain, HOT: terrain elevation
+    double3 pos;                        //< terrain point
+    float3 norm;                        //< terrain normal
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class igc_query_service
+{
+public:
+
+    ///Service configuration
+    struct params
+    {
+        double max_segment = 2000.0;        //< max length of a single intersect call [m]
+        double min_elevation = -500.0;      //< lowest terrain elevation searched by HAT/HOT [m]
+        double max_elevation = 9000.0;      //< highest terrain elevation searched by HAT/HOT [m]
+        uint segment_budget = 2048;         //< max intersect calls per process()
+        double radius = rad_eq;             //< sea level radius for HOT elevations
+    };
+
+    ///Counters of the last process() call
+    struct stats
+    {
+        uint submitted = 0;             //< requests taken from the submission queue
+        uint completed = 0;             //< requests finished
+        uint pending = 0;               //< requests carried over to the next frame
+        uint segments = 0;              //< intersect calls made
+    };
+
+    igc_query_service()
+        : igc_query_service(params())
+    {}
+
+    explicit igc_query_service( const params& p )
+        : _params(p)
+        , _mx(500, false)
+    {}
+
+    params& get_params() { return _params; }
+
+    ///Submit requests, can be called from any thread
+    void submit( const igc_query* q, uint n )
+    {
+        std::lock_guard<coid::comm_mutex> lock(_mx);
+        igc_query* dst = _incoming.add(n);
+        for (uint i = 0; i < n; ++i)
+            dst[i] = q[i];
+    }
+
+    ///Execute pending requests, call from igc::update
+    //@return number of requests completed
+    uint process( igc& ig )
+    {
+        _stats = stats();
+
+        {
+            std::lock_guard<coid::comm_mutex> lock(_mx);
+            _stats.submitted = uint(_incoming.size());
+            _queue.swap(_incoming);
+        }
+
+        //new requests after those carried over from the last frame
+        uint nmiss = 0;
+        for (uint i = 0; i < _queue.size(); ++i)
+            nmiss += !start(_queue[i]);
+        _queue.reset();
+
+        uint budget = _params.segment_budget;
+        uint done = 0;
+
+        for (; done < _active.size() && budget; ++done)
+        {
+            job& j = _active[done];
+            if (!run(ig, j, budget)) {
+                //out of budget
+                break;
+            }
+            finish(j);
+        }
+
+        //keep the unfinished requests in order
+        uint left = uint(_active.size()) - done;
+        if (done && left)
+            ::memmove(_active.ptr(), _active.ptr() + done, left * sizeof(job));
+        _active.resize(left);
+
+        _stats.completed = done + nmiss;
+        _stats.pending = left;
+        return done + nmiss;
+    }
+
+    ///Fetch results completed since the last fetch
+    //@param out [out] swapped with the internal result buffer
+    void fetch( coid::dynarray<igc_query_result>& out )
+    {
+        out.reset();
+        out.swap(_results);
+    }
+
+    const stats& get_stats() const { return _stats; }
+
+private:
+
+    struct job
+    {
+        igc_query q;
+        double3 from;                   //< ray start
+        double3 dir;                    //< unit ray direction
+        double length;                  //< total ray length
+        double done;                    //< length tested or skipped so far
+        bool hit;
+        double3 hpos;
+        float3 hnorm;
+        double hdist;
+    };
+
+    ///Start the request
+    //@return false if the request was finished right away
+    bool start( const igc_query& q )
+    {
+        if (q.type != igc_query::LOS && q.pos == double3(0)) {
+            //no vertical direction at the planet center, finish as a miss
+            job miss;
+            miss.q = q;
+            miss.hit = false;
+            finish(miss);
+            return false;
+        }
+
+        job* j = _active.add();
+        j->q = q;
+        j->done = 0;
+        j->hit = false;
+
+        if (q.type == igc_query::LOS) {
+            j->from = q.pos;
+            double3 d = q.to - q.pos;
+            j->length = glm::length(d);
+            j->dir = j->length > 0 ? d / j->length : double3(0);
+        }
+        else {
+            //vertical ray down through the terrain elevation band
+            double r = glm::length(q.pos);
+            double3 up = q.pos / r;
+            double top = _params.radius + _params.max_elevation;
+            double bottom = _params.radius + _params.min_elevation;
+
+            if (q.type == igc_query::HAT) {
+                //from pos, skipping the empty part above the band
+                j->from = q.pos;
+                j->done = glm::max(0.0, r - top);
+                j->length = glm::max(0.0, r - bottom);
+            }
+            else {
+                j->from = up * top;
+                j->length = top - bottom;
+            }
+            j->dir = -up;
+        }
+        return true;
+    }
+
+    ///Test remaining segments of the job
+    //@return false if the budget ran out before the job finished
+    bool run( igc& ig, job& j, uint& budget )
+    {
+        while (j.done < j.length)
+        {
+            if (!budget)
+                return false;
+            --budget;
+            ++_stats.segments;
+
+            double seg = glm::min(_params.max_segment, j.length - j.done);
+            double3 a = j.from + j.dir * j.done;
+            double3 b = a + j.dir * seg;
+
+            double3 pos;
+            float3 norm;
+            double d = ig.intersect(a, b, pos, norm);
+            if (d >= 0) {
+                j.hit = true;
+                j.hpos = pos;
+                j.hnorm = norm;
+                j.hdist = j.done + d;
+                return true;
+            }
+
+            j.done += seg;
+        }
+        return true;
+    }
+
+    void finish( const job& j )
+    {
+        igc_query_result* r = _results.add();
+        r->id = j.q.id;
+        r->hit = j.hit;
+        r->pos = j.hit ? j.hpos : double3(0);
+        r->norm = j.hit ? j.hnorm : float3(0);
+
+        if (!j.hit)
+            r->distance = -1;
+        else if (j.q.type == igc_query::LOS)
+            r->distance = j.hdist;
+        else if (j.q.type == igc_query::HAT)
+            r->distance = j.hdist;
+        else
+            r->distance = glm::length(j.hpos) - _params.radius;
+    }
+
+private:
+
+    params _params;
+
+    coid::comm_mutex _mx;
+    coid::dynarray<igc_query> _incoming;    //< submitted requests, guarded by _mx
+    coid::dynarray<igc_query> _queue;       //< requests taken for processing
+
+    coid::dynarray<job> _active;            //< requests in progress, in submission order
+    coid::dynarray<igc_query_result> _results;
+
+    stats _stats;
+};
+
+} //namespace ot
+
+#endif //__OT_IGC_QUERY_H__
@@ -0,0 +1,719 @@
+#pragma once
+#ifndef __OT_IK_SOLVER_H__
+#define __OT_IK_SOLVER_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "geomob.h"
+#include "geom_types.h"
+#include "glm/glm_ext.h"
+
+/**
+    Inverse kinematics on geomob bones.
+
+    ik_skeleton reads the bone hierarchy (get_bone_meta_ptr) and the bind
+    pose (get_bone_model_bp_tm) of a geomob model once, and holds the IK
+    chains and per-joint limits defined on it. A chain is a run of joints
+    from a root joint down to the tip (end effector) joint, each the parent
+    of the next one.
+
+    ik_solver solves a chain in model space against the current local bone
+    transforms of a geomob (get_bone_local_ptr) and writes the resulting
+    local rotations of all chain joints back in one pass, instead of
+    rotating joints one by one via rotate_joint. The geomob should be in
+    AnimExplicit mode, or the IK applied after animate(). Solvers:
+        IK_TWO_BONE - analytic two-bone (3 joints), with a pole target
+                      controlling the bend plane (knees, elbows)
+        IK_FABRIK   - forward and backward reaching, any chain length
+        IK_CCD      - cyclic coordinate descent, any chain length
+    Joint limits (cone or hinge, relative to the bind pose) are applied by
+    FABRIK and CCD.
+
+    ik_batch solves many chains of many characters in parallel on the given
+    number of worker threads; the calling thread participates. The workers
+    are owned by the batch, so systems should share one batch rather than
+    each creating its own. Solving only touches the bone buffers of the
+    jobs, so the bone pointers should be fetched on the main thread.
+
+    A chain is solved against the current transforms of its ancestors, so
+    the chains of one character (jobs with the same bone buffer) are solved
+    in sequence by one thread, in the order they were added: add chains
+    that move the ancestors of others (spine) before those (arms). Only
+    different characters are solved in parallel. No two chains of one
+    character should share joints.
+
+    Example:
+        ot::ik_skeleton skel;
+        skel.init(*geom);
+        uint leg = skel.add_chain(foot_joint, 3, ot::IK_TWO_BONE);
+        uint arm = skel.add_chain(hand_joint, 4, ot::IK_CCD);
+        skel.set_limit(elbow_joint, ot::ik_limit::hinge(float3(1, 0, 0), 0, 2.6f));
+
+        ot::ik_batch batch(3);
+        //each frame, targets in model space
+        batch.clear();
+        batch.add(&skel, leg, geom->get_bone_local_ptr(), foot_target, knee_pole);
+        batch.add(&skel, arm, geom->get_bone_local_ptr(), hand_target);
+        batch.solve();
+**/
+
+namespace ot {
+
+enum EIKSolver : uint8 {
+    IK_TWO_BONE,
+    IK_FABRIK,
+    IK_CCD,
+};
+
+///Joint rotation limit relative to the bind pose local rotation
+struct ik_limit
+{
+    enum EType : uint8 {
+        NONE,
+        CONE,                           //< max rotation angle from the bind pose
+        HINGE,                          //< rotation about a single axis within a range
+    };
+
+    EType type = NONE;
+    float3 axis = float3(1, 0, 0);      //< hinge axis in the bind pose local space
+    float min_angle = 0;                //< hinge min angle [rad]
+    float max_angle = 0;                //< hinge max angle, or cone angle [rad]
+
+    static ik_limit cone( float angle ) {
+        ik_limit l;
+        l.type = CONE;
+        l.max_angle = angle;
+        return l;
+    }
+
+    static ik_limit hinge( const float3& axis, float min_angle, float max_angle ) {
+        ik_limit l;
+        l.type = HINGE;
+        l.axis = glm::normalize(axis);
+        l.min_angle = min_angle;
+        l.max_angle = max_angle;
+        return l;
+    }
+};
+
+///Solver configuration
+struct ik_params
+{
+    uint max_iterations = 16;           //< FABRIK and CCD iterations
+    float tolerance = 0.001f;           //< distance to the target considered reached [m]
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///Bone hierarchy, bind pose, chains and limits of a geomob model
+class ik_skeleton
+{
+public:
+
+    enum { MAX_CHAIN = 32 };            //< max joints in a chain
+
+    struct chain
+    {
+        uint first;                     //< offset of the joints in the joint list
+        uint count;                     //< number of joints including the tip
+        EIKSolver solver;
+    };
+
+    ///Read bone hierarchy and bind pose from geomob
+    //@return false if the geomob has no bones yet
+    bool init( const geomob& geom )
+    {
+        uint n = geom.get_num_bones();
+        const pkg::bone_meta2* meta = geom.get_bone_meta_ptr();
+        if (!n || !meta)
+            return false;
+
+        _parent.resize(n);
+        _bind_rot.resize(n);
+        _limit.resize(n);
+        _chains.reset();
+        _joints.reset();
+
+        coid::dynarray<quat> model_rot;
+        model_rot.resize(n);
+
+        for (uint b = 0; b < n; ++b) {
+            float3 pos;
+            geom.get_bone_model_bp_tm(b, pos, model_rot[b]);
+            _parent[b] = meta[b]._parent_idx;
+            _limit[b] = ik_limit();
+        }
+
+        for (uint b = 0; b < n; ++b) {
+            uint p = _parent[b];
+            _bind_rot[b] = p < n
+                ? glm::normalize(glm::conjugate(model_rot[p]) * model_rot[b])
+                : model_rot[b];
+        }
+
+        return true;
+    }
+
+    ///Define chain from the tip joint up the hierarchy
+    //@param tip end effector joint
+    //@param count number of joints including the tip, 3 for IK_TWO_BONE
+    //@return chain id, or UMAX32 if the hierarchy is not deep enough
+    uint add_chain( uint tip, uint count, EIKSolver solver )
+    {
+        if (solver == IK_TWO_BONE)
+            count = 3;
+        if (count < 2 || count > MAX_CHAIN || tip >= bone_count())
+            return UMAX32;
+
+        uint first = uint(_joints.size());
+        uint* j = _joints.add(count);
+
+        uint b = tip;
+        for (uint i = count; i-- > 0; ) {
+            if (b >= bone_count()) {
+                _joints.resize(first);
+                return UMAX32;
+            }
+            j[i] = b;
+            b = _parent[b];
+        }
+
+        chain* c = _chains.add();
+        c->first = first;
+        c->count = count;
+        c->solver = solver;
+        return uint(_chains.size() - 1);
+    }
+
+    void set_limit( uint bone, const ik_limit& limit ) { _limit[bone] = limit; }
+
+    uint bone_count() const { return uint(_parent.size()); }
+    uint chain_count() const { return uint(_chains.size()); }
+
+    //@return parent bone, or an invalid id (>= bone_count) for the root
+    uint parent( uint bone ) const { return _parent[bone]; }
+
+    //@return bind pose local rotation
+    const quat& bind_rot( uint bone ) const { return _bind_rot[bone]; }
+    const ik_limit& limit( uint bone ) const { return _limit[bone]; }
+
+    const chain& get_chain( uint id ) const { return _chains[id]; }
+    const uint* chain_joints( uint id ) const { return _joints.ptr() + _chains[id].first; }
+
+private:
+
+    coid::dynarray<uint> _parent;
+    coid::dynarray<quat> _bind_rot;
+    coid::dynarray<ik_limit> _limit;
+
+    coid::dynarray<chain> _chains;
+    coid::dynarray<uint> _joints;       //< chain joints, root first
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class ik_solver
+{
+public:
+
+    ///Solve chain and write local rotations of its joints
+    //@param bones local bones from geomob::get_bone_local_ptr()
+    //@param target tip target position in model space
+    //@param pole bend direction hint in model space (IK_TWO_BONE), ignored if zero
+    //@param iterations [out] optional number of iterations done
+    //@return true if the target was reached within the tolerance
+    static bool solve( const ik_skeleton& skel, uint chain_id, pkg::bone_data* bones,
+        const float3& target, const float3& pole, const ik_params& p = ik_params(), uint* iterations = 0 )
+    {
+        const ik_skeleton::chain& c = skel.get_chain(chain_id);
+        state s;
+        s.skel = &skel;
+        s.joints = skel.chain_joints(chain_id);
+        s.n = c.count;
+
+        s.load(bones);
+
+        uint iter = 0;
+        switch (c.solver) {
+        case IK_TWO_BONE: two_bone(s, target, pole); iter = 1; break;
+        case IK_FABRIK:   iter = fabrik(s, target, p); break;
+        case IK_CCD:      iter = ccd(s, target, p); break;
+        }
+
+        s.store(bones);
+
+        if (iterations)
+            *iterations = iter;
+
+        return glm::length(s.pos[s.n - 1] - target) <= p.tolerance;
+    }
+
+private:
+
+    ///Chain in model space, joints root first
+    struct state
+    {
+        const ik_skeleton* skel;
+        const uint* joints;
+        uint n;
+
+        float3 root_pos;                //< model transform of the parent of the chain root
+        quat root_rot;
+
+        float3 lpos[ik_skeleton::MAX_CHAIN];
+        quat lrot[ik_skeleton::MAX_CHAIN];
+        float3 pos[ik_skeleton::MAX_CHAIN];
+        quat rot[ik_skeleton::MAX_CHAIN];
+
+        const quat& parent_rot( uint i ) const { return i ? rot[i - 1] : root_rot; }
+
+        void load( const pkg::bone_data* bones )
+        {
+            //model transform of the chain root parent
+            root_pos = float3(0);
+            root_rot = quat(1, 0, 0, 0);
+
+            for (uint b = skel->parent(joints[0]); b < skel->bone_count(); b = skel->parent(b)) {
+                const pkg::bone_data& bd = bones[b];
+                root_pos = bd._rot * root_pos + glm::dquat_to_trans(bd._rot, bd._dual);
+                root_rot = bd._rot * root_rot;
+            }
+
+            for (uint i = 0; i < n; ++i) {
+                const pkg::bone_data& bd = bones[joints[i]];
+                lrot[i] = bd._rot;
+                lpos[i] = glm::dquat_to_trans(bd._rot, bd._dual);
+            }
+
+            fk(0);
+        }
+
+        ///Recompute model transforms from joint i down to the tip
+        void fk( uint i )
+        {
+            for (; i < n; ++i) {
+                const quat& pr = parent_rot(i);
+                pos[i] = (i ? pos[i - 1] : root_pos) + pr * lpos[i];
+                rot[i] = pr * lrot[i];
+            }
+        }
+
+        ///Set model rotation of joint i, applying its limit
+        void set_rot( uint i, const quat& q, bool limit )
+        {
+            lrot[i] = glm::normalize(glm::conjugate(parent_rot(i)) * q);
+            if (limit)
+                lrot[i] = constrain(lrot[i], skel->bind_rot(joints[i]), skel->limit(joints[i]));
+            rot[i] = parent_rot(i) * lrot[i];
+        }
+
+        ///Write local rotations of all joints except the tip
+        void store( pkg::bone_data* bones ) const
+        {
+            for (uint i = 0; i + 1 < n; ++i) {
+                pkg::bone_data& bd = bones[joints[i]];
+                bd._rot = lrot[i];
+                bd._dual = glm::to_dquat(lrot[i], lpos[i]);
+            }
+        }
+    };
+
+    static void two_bone( state& s, const float3& target, const float3& pole )
+    {
+        const float3 a = s.pos[0], b = s.pos[1], c = s.pos[2];
+
+        float lab = glm::length(b - a);
+        float lcb = glm::length(c - b);
+        float lat = glm::clamp(glm::length(target - a), 1e-5f, lab + lcb - 1e-5f);
+
+        float3 ac = safe_normalize(c - a);
+        float3 ab = safe_normalize(b - a);
+        float3 bc = safe_normalize(c - b);
+        float3 at = safe_normalize(target - a);
+
+        //current and desired interior angles
+        float ac_ab_0 = acosf(glm::clamp(glm::dot(ac, ab), -1.0f, 1.0f));
+        float ba_bc_0 = acosf(glm::clamp(glm::dot(-ab, bc), -1.0f, 1.0f));
+        float ac_at_0 = acosf(glm::clamp(glm::dot(ac, at), -1.0f, 1.0f));
+        float ac_ab_1 = acosf(glm::clamp((lcb * lcb - lab * lab - lat * lat) / (-2 * lab * lat), -1.0f, 1.0f));
+        float ba_bc_1 = acosf(glm::clamp((lat * lat - lab * lab - lcb * lcb) / (-2 * lab * lcb), -1.0f, 1.0f));
+
+        //bend plane normal, from the current bend or the pole when straight
+        float3 axis0 = glm::cross(ac, ab);
+        if (glm::length_squared(axis0) < 1e-10f && glm::length_squared(pole) > 0)
+            axis0 = glm::cross(ac, pole - a);
+        if (glm::length_squared(axis0) < 1e-10f)
+            axis0 = orthogonal(ac);
+        axis0 = glm::normalize(axis0);
+
+        float3 axis1 = glm::cross(ac, at);
+        axis1 = glm::length_squared(axis1) < 1e-10f ? axis0 : glm::normalize(axis1);
+
+        quat r0 = glm::angleAxis(ac_ab_1 - ac_ab_0, axis0);
+        quat r1 = glm::angleAxis(ba_bc_1 - ba_bc_0, axis0);
+        quat r2 = glm::angleAxis(ac_at_0, axis1);
+
+        quat ra = r2 * r0;
+        quat rb = ra * r1;
+
+        //twist the bend plane about the root-target axis towards the pole
+        if (glm::length_squared(pole) > 0) {
+            float3 nb = ra * (b - a);
+            float3 pb = nb - at * glm::dot(nb, at);
+            float3 pp = (pole - a) - at * glm::dot(pole - a, at);
+            if (glm::length_squared(pb) > 1e-10f && glm::length_squared(pp) > 1e-10f) {
+                quat rp = from_to(glm::normalize(pb), glm::normalize(pp));
+                ra = rp * ra;
+                rb = rp * rb;
+            }
+        }
+
+        quat qa = ra * s.rot[0];
+        quat qb = rb * s.rot[1];
+
+        s.set_rot(0, qa, false);
+        s.set_rot(1, qb, false);
+        s.fk(1);
+    }
+
+    static uint fabrik( state& s, const float3& target, const ik_params& p )
+    {
+        const uint n = s.n;
+        float3 pt[ik_skeleton::MAX_CHAIN];
+        float len[ik_skeleton::MAX_CHAIN];
+
+        float reach = 0;
+        for (uint i = 0; i < n; ++i) {
+            pt[i] = s.pos[i];
+            if (i + 1 < n) {
+                len[i] = glm::length(s.pos[i + 1] - s.pos[i]);
+                reach += len[i];
+            }
+        }
+
+        const float3 base = pt[0];
+        uint iter = 0;
+
+        if (glm::length(target - base) >= reach) {
+            //out of reach, stretch towards the target
+            float3 dir = safe_normalize(target - base);
+            for (uint i = 0; i + 1 < n; ++i)
+                pt[i + 1] = pt[i] + dir * len[i];
+            iter = 1;
+        }
+        else {
+            while (iter < p.max_iterations && glm::length(pt[n - 1] - target) > p.tolerance)
+            {
+                pt[n - 1] = target;
+                for (uint i = n - 1; i-- > 0; )
+                    pt[i] = pt[i + 1] + safe_normalize(pt[i] - pt[i + 1]) * len[i];
+
+                pt[0] = base;
+                for (uint i = 0; i + 1 < n; ++i)
+                    pt[i + 1] = pt[i] + safe_normalize(pt[i + 1] - pt[i]) * len[i];
+
+                ++iter;
+            }
+        }
+
+        //rotate joints to aim at the solved positions, limits may pull the chain off them
+        for (uint i = 0; i + 1 < n; ++i)
+        {
+            s.fk(i);
+            float3 cur = s.pos[i + 1] - s.pos[i];
+            float3 want = pt[i + 1] - s.pos[i];
+            if (glm::length_squared(cur) < 1e-12f || glm::length_squared(want) < 1e-12f)
+                continue;
+
+            s.set_rot(i, from_to(glm::normalize(cur), glm::normalize(want)) * s.rot[i], true);
+        }
+        s.fk(n - 1);
+
+        return iter;
+    }
+
+    static uint ccd( state& s, const float3& target, const ik_params& p )
+    {
+        const uint n = s.n;
+        uint iter = 0;
+
+        while (iter < p.max_iterations && glm::length(s.pos[n - 1] - target) > p.tolerance)
+        {
+            for (uint i = n - 1; i-- > 0; )
+            {
+                float3 cur = s.pos[n - 1] - s.pos[i];
+                float3 want = target - s.pos[i];
+                if (glm::length_squared(cur) < 1e-12f || glm::length_squared(want) < 1e-12f)
+                    continue;
+
+                s.set_rot(i, from_to(glm::normalize(cur), glm::normalize(want)) * s.rot[i], true);
+                s.fk(i + 1);
+            }
+            ++iter;
+        }
+
+        return iter;
+    }
+
+    ///Clamp local rotation to the joint limit
+    static quat constrain( const quat& q, const quat& bind, const ik_limit& l )
+    {
+        if (l.type == ik_limit::NONE)
+            return q;
+
+        quat rel = glm::conjugate(bind) * q;
+        if (rel.w < 0)
+            rel = -rel;
+
+        float3 v(rel.x, rel.y, rel.z);
+
+        if (l.type == ik_limit::CONE) {
+            float s = glm::length(v);
+            float angle = 2 * atan2f(s, rel.w);
+            if (angle <= l.max_angle || s < 1e-7f)
+                return q;
+            rel = glm::angleAxis(l.max_angle, v / s);
+        }
+        else {
+            //keep the twist about the hinge axis only
+            float angle = 2 * atan2f(glm::dot(v, l.axis), rel.w);
+            rel = glm::angleAxis(glm::clamp(angle, l.min_angle, l.max_angle), l.axis);
+        }
+
+        return bind * rel;
+    }
+
+    ///Shortest rotation from unit vector u to unit vector v
+    static quat from_to( const float3& u, const float3& v )
+    {
+        float d = glm::dot(u, v);
+        if (d < -0.999999f)
+            return glm::angleAxis(float(M_PI), orthogonal(u));
+
+        float3 c = glm::cross(u, v);
+        return glm::normalize(quat(1 + d, c.x, c.y, c.z));
+    }
+
+    static float3 orthogonal( const float3& v )
+    {
+        float3 o = fabsf(v.x) < 0.9f ? float3(1, 0, 0) : float3(0, 1, 0);
+        return glm::normalize(glm::cross(v, o));
+    }
+
+    static float3 safe_normalize( const float3& v )
+    {
+        float l = glm::length(v);
+        return l > 1e-12f ? v / l : float3(0);
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///Parallel solver of many IK chains
+class ik_batch
+{
+public:
+
+    ///Counters of the last solve
+    struct stats
+    {
+        uint jobs = 0;                  //< chains solved
+        uint reached = 0;               //< chains that reached the target
+        uint iterations = 0;            //< total solver iterations
+        float ms = 0;                   //< time spent in solve [ms]
+    };
+
+    //@param nthreads number of worker threads in addition to the calling one, 0 to solve on the calling thread only
+    explicit ik_batch( uint nthreads = 0, const ik_params& p = ik_params() )
+        : _params(p)
+    {
+        _nworkers = nthreads;
+        if (_nworkers) {
+            _threads = new std::thread[_nworkers];
+            for (uint i = 0; i < _nworkers; ++i)
+                _threads[i] = std::thread([this]() { worker(); });
+        }
+    }
+
+    ~ik_batch()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mx);
+            _quit = true;
+        }
+        _cv.notify_all();
+
+        for (uint i = 0; i < _nworkers; ++i)
+            _threads[i].join();
+
+        delete[] _threads;
+    }
+
+    ik_params& get_params() { return _params; }
+
+    ///Add chain to solve
+    //@param bones local bones of the character, from geomob::get_bone_local_ptr()
+    //@param target tip target position in model space
+    //@param pole bend direction hint in model space (IK_TWO_BONE)
+    //@return job index
+    uint add( const ik_skeleton* skel, uint chain_id, pkg::bone_data* bones, const float3& target, const float3& pole = float3(0) )
+    {
+        DASSERT(chain_id < skel->chain_count());
+
+        job* j = _jobs.add();
+        j->skel = skel;
+        j->chain = chain_id;
+        j->bones = bones;
+        j->target = target;
+        j->pole = pole;
+        j->reached = false;
+        j->iterations = 0;
+        return uint(_jobs.size() - 1);
+    }
+
+    void clear() { _jobs.reset(); }
+
+    ///Solve all jobs on the worker threads and the calling thread, blocks until done
+    void solve()
+    {
+        auto t0 = std::chrono::high_resolution_clock::now();
+
+        group();
+        _next = 0;
+
+        if (_nworkers && _groups.size() - 1 > GRAIN) {
+            {
+                std::lock_guard<std::mutex> lock(_mx);
+                _finished = 0;
+                ++_generation;
+            }
+            _cv.notify_all();
+
+            work();
+
+            std::unique_lock<std::mutex> lock(_mx);
+            _cv.wait(lock, [this]() { return _finished == _nworkers; });
+        }
+        else
+            work();
+
+        _stats = stats();
+        _stats.jobs = uint(_jobs.size());
+        for (uint i = 0, n = uint(_jobs.size()); i < n; ++i) {
+            _stats.reached += _jobs[i].reached;
+            _stats.iterations += _jobs[i].iterations;
+        }
+
+        auto t1 = std::chrono::high_resolution_clock::now();
+        _stats.ms = std::chrono::duration<float, std::milli>(t1 - t0).count();
+    }
+
+    //@return true if the job reached its target in the last solve
+    bool reached( uint job ) const { return _jobs[job].reached; }
+
+    const stats& get_stats() const { return _stats; }
+
+private:
+
+    enum { GRAIN = 8 };                 //< characters taken by a thread at once
+
+    struct job
+    {
+        const ik_skeleton* skel;
+        uint chain;
+        pkg::bone_data* bones;
+        float3 target;
+        float3 pole;
+        bool reached;
+        uint iterations;
+    };
+
+    ///Group the jobs by character, keeping the order of the chains within a character
+    void group()
+    {
+        const uint n = uint(_jobs.size());
+        _order.resize(n);
+        for (uint i = 0; i < n; ++i)
+            _order[i] = i;
+
+        std::stable_sort(_order.ptr(), _order.ptr() + n, [this](uint a, uint b) {
+            return uints(_jobs[a].bones) < uints(_jobs[b].bones);
+        });
+
+        _groups.reset();
+        for (uint i = 0; i < n; ++i)
+            if (!i || _jobs[_order[i]].bones != _jobs[_order[i - 1]].bones)
+                *_groups.add() = i;
+        *_groups.add() = n;
+    }
+
+    void work()
+    {
+        const uint n = uint(_groups.size() - 1);
+        for (;;) {
+            uint g = _next.fetch_add(GRAIN);
+            if (g >= n)
+                break;
+
+            uint e = g + GRAIN < n ? g + GRAIN : n;
+            for (; g < e; ++g) {
+                //chains of one character in sequence
+                for (uint k = _groups[g]; k < _groups[g + 1]; ++k) {
+                    job& j = _jobs[_order[k]];
+                    j.reached = ik_solver::solve(*j.skel, j.chain, j.bones, j.target, j.pole, _params, &j.iterations);
+                }
+            }
+        }
+    }
+
+    void worker()
+    {
+        std::unique_lock<std::mutex> lock(_mx);
+        uint seen = 0;
+
+        for (;;) {
+            _cv.wait(lock, [&]() { return _generation != seen || _quit; });
+            if (_quit)
+                break;
+            seen = _generation;
+
+            lock.unlock();
+            work();
+            lock.lock();
+
+            if (++_finished == _nworkers)
+                _cv.notify_all();
+        }
+    }
+
+private:
+
+    ik_params _params;
+    coid::dynarray<job> _jobs;
+    coid::dynarray<uint> _order;        //< job indices grouped by character
+    coid::dynarray<uint> _groups;       //< start of each character in _order, followed by the job count
+
+    uint _nworkers = 0;
+    std::thread* _threads = 0;
+
+    std::mutex _mx;
+    std::condition_variable _cv;
+    std::atomic<uint> _next{0};
+    uint _generation = 0;
+    uint _finished = 0;
+    bool _quit = false;
+
+    stats _stats;
+};
+
+} //namespace ot
+
+#endif //__OT_IK_SOLVER_H__
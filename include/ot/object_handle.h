@@ -0,0 +1,264 @@
+#pragma once
+#ifndef __OT_OBJECT_HANDLE_H__
+#define __OT_OBJECT_HANDLE_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+
+#include "geomob.h"
+
+/**
+    Non-owning versioned handles to interface objects.
+
+    Creators like geomob::from_entity_id or object::get return iref<T>,
+    whose every copy and release is an atomic refcount operation on a cache
+    line shared with the engine threads. Code touching thousands of objects
+    per frame should instead resolve each object once into an
+    object_handle_table, which keeps the single owning iref, and pass
+    around object_handle values: a slot index and a generation.
+
+    Access through a handle is validated against the slot generation: once
+    the slot is released or found dead, all handles to it resolve to null.
+    Liveness of the objects is checked by refresh(), which re-resolves a
+    bounded number of slots per call by their entity handle and invalidates
+    those that no longer resolve.
+
+    Bulk acquire() and resolve() take arrays of entity handles or object
+    handles, so tight loops work with plain pointers without touching the
+    refcounts.
+
+    Example:
+        ot::object_handle_table<ot::geomob> geoms;
+
+        ot::object_handle<ot::geomob> h = geoms.acquire(eid);
+
+        //each frame
+        geoms.refresh(64);
+        uint n = geoms.resolve(handles.ptr(), handles.size(), ptrs.ptr());
+        for (ot::geomob* g : ptrs)
+            if (g) g->...;
+**/
+
+namespace ot {
+
+///Non-owning handle to an object in an object_handle_table
+template <class T>
+struct object_handle
+{
+    uint slot = UMAX32;
+    uint gen = 0;
+
+    bool is_set() const { return slot != UMAX32; }
+
+    bool operator == ( const object_handle& h ) const { return slot == h.slot && gen == h.gen; }
+    bool operator != ( const object_handle& h ) const { return !(*this == h); }
+};
+
+///Default resolver of entity handles, through the generated creator
+template <class T>
+struct object_resolver;
+
+template <>
+struct object_resolver<geomob> {
+    static iref<geomob> resolve( entity_handle eid ) {
+        return geomob::from_entity_id(eid);
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+template <class T>
+class object_handle_table
+{
+public:
+
+    typedef iref<T> (*fn_resolve)(entity_handle);
+
+    ///Table statistics
+    struct stats
+    {
+        uint live = 0;                  //< slots holding an object
+        uint refreshed = 0;             //< slots re-validated by the last refresh()
+        uint invalidated = 0;           //< slots found dead by the last refresh()
+    };
+
+    explicit object_handle_table( fn_resolve resolve = &object_resolver<T>::resolve )
+        : _resolve(resolve)
+    {}
+
+    ///Resolve entity and take its reference
+    //@return handle, not set if the entity could not be resolved
+    object_handle<T> acquire( entity_handle eid )
+    {
+        object_handle<T> h;
+        iref<T> obj = _resolve(eid);
+        if (!obj)
+            return h;
+
+        uint id;
+        if (_free.size()) {
+            id = _free.last();
+            _free.resize(_free.size() - 1);
+        }
+        else {
+            id = uint(_slots.size());
+            slot* s = _slots.add();
+            s->gen = 0;
+        }
+
+        slot& s = _slots[id];
+        s.ptr = obj.get();
+        s.ref = obj;
+        s.eid = eid;
+
+        ++_stats.live;
+
+        h.slot = id;
+        h.gen = s.gen;
+        return h;
+    }
+
+    ///Bulk acquire
+    //@param out [out] n handles, unset for entities that could not be resolved
+    //@return number of resolved entities
+    uint acquire( const entity_handle* eids, uint n, object_handle<T>* out )
+    {
+        uint ok = 0;
+        for (uint i = 0; i < n; ++i) {
+            out[i] = acquire(eids[i]);
+            ok += out[i].is_set();
+        }
+        return ok;
+    }
+
+    ///Release the reference, invalidating all copies of the handle
+    void release( object_handle<T> h )
+    {
+        if (valid(h))
+            free_slot(h.slot);
+    }
+
+    //@return true if the handle refers to a live object
+    bool valid( object_handle<T> h ) const {
+        return h.slot < _slots.size() && _slots[h.slot].gen == h.gen && _slots[h.slot].ptr;
+    }
+
+    //@return object pointer, or null if the handle is no longer valid
+    //@note the pointer is valid until the next release() or refresh()
+    T* get( object_handle<T> h ) const {
+        return h.slot < _slots.size() && _slots[h.slot].gen == h.gen ? _slots[h.slot].ptr : 0;
+    }
+
+    //@return entity handle of the object
+    entity_handle eid( object_handle<T> h ) const {
+        return valid(h) ? _slots[h.slot].eid : entity_handle();
+    }
+
+    ///Bulk resolve handles to object pointers
+    //@param out [out] n pointers, null for invalid handles
+    //@return number of valid handles
+    uint resolve( const object_handle<T>* h, uint n, T** out ) const
+    {
+        const slot* slots = _slots.ptr();
+        const uint ns = uint(_slots.size());
+        uint ok = 0;
+
+        for (uint i = 0; i < n; ++i) {
+            uint k = h[i].slot;
+            T* p = k < ns && slots[k].gen == h[i].gen ? slots[k].ptr : 0;
+            out[i] = p;
+            ok += p != 0;
+        }
+        return ok;
+    }
+
+    ///Re-validate a bounded number of slots, round robin
+    //@param budget max slots to re-resolve
+    //@return number of slots invalidated
+    uint refresh( uint budget )
+    {
+        _stats.refreshed = _stats.invalidated = 0;
+
+        const uint ns = uint(_slots.size());
+        if (!ns)
+            return 0;
+
+        if (budget > ns)
+            budget = ns;
+
+        for (uint i = 0; i < budget; ++i)
+        {
+            if (_cursor >= ns)
+                _cursor = 0;
+            uint k = _cursor++;
+
+            slot& s = _slots[k];
+            if (!s.ptr)
+                continue;
+
+            ++_stats.refreshed;
+            //entity handles are versioned, a dead entity no longer resolves;
+            //the creator may return a new wrapper for a live one
+            if (!_resolve(s.eid)) {
+                free_slot(k);
+                ++_stats.invalidated;
+            }
+        }
+
+        return _stats.invalidated;
+    }
+
+    ///Invalidate all handles to given entity, e.g. on a host removal notification
+    void invalidate( entity_handle eid )
+    {
+        for (uint i = 0, n = uint(_slots.size()); i < n; ++i)
+            if (_slots[i].ptr && _slots[i].eid == eid)
+                free_slot(i);
+    }
+
+    ///Release all objects, invalidating all handles
+    void clear()
+    {
+        for (uint i = 0, n = uint(_slots.size()); i < n; ++i)
+            if (_slots[i].ptr)
+                free_slot(i);
+    }
+
+    const stats& get_stats() const { return _stats; }
+
+private:
+
+    struct slot
+    {
+        T* ptr = 0;                     //< cached object pointer, null if free
+        iref<T> ref;                    //< the owning reference
+        entity_handle eid;
+        uint gen = 0;
+    };
+
+    void free_slot( uint k )
+    {
+        slot& s = _slots[k];
+        s.ptr = 0;
+        s.ref.release();
+        s.eid = entity_handle();
+        ++s.gen;
+
+        *_free.add() = k;
+        --_stats.live;
+    }
+
+    fn_resolve _resolve;
+
+    coid::dynarray<slot> _slots;
+    coid::dynarray<uint> _free;
+    uint _cursor = 0;
+
+    stats _stats;
+};
+
+} //namespace ot
+
+#endif //__OT_OBJECT_HANDLE_H__
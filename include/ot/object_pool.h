@@ -0,0 +1,258 @@
+#pragma once
+#ifndef __OT_OBJECT_POOL_H__
+#define __OT_OBJECT_POOL_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+#include <comm/token.h>
+#include <comm/str.h>
+
+#include "cubeface.h"
+#include "fnv_hash.h"
+#include "geomob.h"
+#include "static_object.h"
+#include "glm/glm_ext.h"
+
+/**
+    Per-URL pool of reusable geomob or static_object instances.
+
+    Transient objects (debris, shell casings, pickups) are frequently
+    spawned and removed, paying the full instance setup and teardown each
+    time. object_pool parks despawned instances instead: they are hidden
+    with set_visible(false) and moved to a parking position away from the
+    scene, so they don't collide with it. The default parking position is
+    one Earth radius above the north pole, clear of any terrain and camera;
+    set params::park_pos when the scene extends there. The next spawn of
+    the same URL takes the most recently parked instance and just moves it
+    into place.
+
+    Parked instances are trimmed by LRU, removing them from the scene, when
+    the estimated memory of the parked instances exceeds the budget. The
+    per-instance cost of each URL can be set with set_cost.
+
+    Example:
+        ot::object_pool<ot::geomob> pool;
+        uint casing = pool.pool("outerra/m4/casing"_T);
+
+        iref<ot::geomob> g = pool.spawn(casing, pos, rot);
+        ...
+        pool.despawn(casing, g);
+**/
+
+namespace ot {
+
+///Instance creation for object_pool
+template <class T>
+struct pool_factory;
+
+template <>
+struct pool_factory<geomob> {
+    static iref<geomob> create( const coid::token& url, const double3& pos, const quat& rot ) {
+        return geomob::create2(url, entity_handle(), 0xffff, pos, rot);
+    }
+};
+
+template <>
+struct pool_factory<static_object> {
+    static iref<static_object> create( const coid::token& url, const double3& pos, const quat& rot ) {
+        return static_object::create(url, pos, rot);
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+template <class T>
+class object_pool
+{
+public:
+
+    ///Pool configuration
+    struct params
+    {
+        uint64 budget = uint64(64) << 20;   //< max estimated memory of parked instances [B]
+        uint default_cost = 64 << 10;       //< estimated memory of a parked instance [B]
+        double3 park_pos = double3(0, 0, 2 * rad_eq);   //< where parked instances are moved (ECEF), away from any scene
+    };
+
+    ///Counters, cumulative except parked and bytes
+    struct stats
+    {
+        uint64 hits = 0;                //< spawns served from the pool
+        uint64 misses = 0;              //< spawns creating a new instance
+        uint64 parked_total = 0;        //< despawns parked
+        uint64 trimmed = 0;             //< parked instances removed by the budget
+        uint parked = 0;                //< instances currently parked
+        uint64 bytes = 0;               //< estimated memory of parked instances [B]
+
+        float hit_rate() const {
+            uint64 n = hits + misses;
+            return n ? float(double(hits) / n) : 0.0f;
+        }
+    };
+
+    explicit object_pool( const params& p = params() )
+        : _params(p)
+    {}
+
+    ~object_pool() { clear(); }
+
+    params& get_params() { return _params; }
+
+    ///Get pool id for given URL, creating the pool if needed
+    uint pool( const coid::token& url )
+    {
+        uint64 h = hash(url);
+        for (uint i = 0, n = uint(_pools.size()); i < n; ++i)
+            if (_pools[i].hash == h && _pools[i].url == url)
+                return i;
+
+        pool_data* p = _pools.add();
+        p->url = url;
+        p->hash = h;
+        p->cost = _params.default_cost;
+        return uint(_pools.size() - 1);
+    }
+
+    ///Set estimated memory of a parked instance of the pool
+    void set_cost( uint id, uint bytes )
+    {
+        pool_data& p = _pools[id];
+        uint n = uint(p.items.size());
+        _stats.bytes -= uint64(p.cost) * n;
+        p.cost = bytes;
+        _stats.bytes += uint64(p.cost) * n;
+        trim();
+    }
+
+    ///Spawn an instance, reusing a parked one if available
+    iref<T> spawn( uint id, const double3& pos, const quat& rot )
+    {
+        pool_data& p = _pools[id];
+
+        if (p.items.size()) {
+            iref<T> obj = p.items.last().obj;
+            p.items.resize(p.items.size() - 1);
+
+            --_stats.parked;
+            _stats.bytes -= p.cost;
+            ++_stats.hits;
+
+            obj->set_pos_rot(pos, rot);
+            obj->set_visible(true);
+            return obj;
+        }
+
+        ++_stats.misses;
+        return pool_factory<T>::create(p.url, pos, rot);
+    }
+
+    ///Park an instance for reuse, releasing the caller's reference
+    void despawn( uint id, iref<T>& obj )
+    {
+        if (!obj)
+            return;
+
+        pool_data& p = _pools[id];
+
+        obj->set_visible(false);
+        obj->set_pos(_params.park_pos);
+
+        parked* e = p.items.add();
+        e->obj = obj;
+        obj.release();
+        e->stamp = _clock++;
+
+        ++_stats.parked;
+        ++_stats.parked_total;
+        _stats.bytes += p.cost;
+
+        trim();
+    }
+
+    ///Remove least recently parked instances until within the budget
+    void trim() {
+        trim_to(_params.budget);
+    }
+
+    ///Remove all parked instances from the scene
+    void clear()
+    {
+        for (uint i = 0, n = uint(_pools.size()); i < n; ++i) {
+            pool_data& p = _pools[i];
+            for (uint k = 0, nk = uint(p.items.size()); k < nk; ++k)
+                p.items[k].obj->remove_from_scene();
+            p.items.reset();
+        }
+
+        _stats.parked = 0;
+        _stats.bytes = 0;
+    }
+
+    //@return number of instances parked in the pool
+    uint parked_count( uint id ) const { return uint(_pools[id].items.size()); }
+
+    const stats& get_stats() const { return _stats; }
+
+private:
+
+    struct parked
+    {
+        iref<T> obj;
+        uint64 stamp;                   //< park order, for LRU
+    };
+
+    struct pool_data
+    {
+        coid::charstr url;
+        uint64 hash;
+        uint cost;
+        coid::dynarray<parked> items;   //< oldest first
+    };
+
+    void trim_to( uint64 budget )
+    {
+        while (_stats.bytes > budget && _stats.parked)
+        {
+            //pool with the least recently parked instance
+            uint oldest = UMAX32;
+            uint64 stamp = UMAX64;
+            for (uint i = 0, n = uint(_pools.size()); i < n; ++i) {
+                const pool_data& p = _pools[i];
+                if (p.items.size() && p.items[0].stamp < stamp) {
+                    stamp = p.items[0].stamp;
+                    oldest = i;
+                }
+            }
+
+            pool_data& p = _pools[oldest];
+            p.items[0].obj->remove_from_scene();
+
+            uint n = uint(p.items.size());
+            for (uint i = 1; i < n; ++i)
+                p.items[i - 1] = p.items[i];
+            p.items.resize(n - 1);
+
+            --_stats.parked;
+            _stats.bytes -= p.cost;
+            ++_stats.trimmed;
+        }
+    }
+
+    static uint64 hash( const coid::token& url ) {
+        return fnv1a(url.ptr(), url.len());
+    }
+
+private:
+
+    params _params;
+    coid::dynarray<pool_data> _pools;
+    uint64 _clock = 0;
+
+    stats _stats;
+};
+
+} //namespace ot
+
+#endif //__OT_OBJECT_POOL_H__
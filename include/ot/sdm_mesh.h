@@ -0,0 +1,473 @@
+#pragma once
+#ifndef __OT_SDM_MESH_H__
+#define __OT_SDM_MESH_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+#include <comm/str.h>
+
+#include <stdio.h>
+#include <thread>
+
+#include "fb.h"
+#include "fnv_hash.h"
+#include "sdm_types.h"
+#include "glm/glm_ext.h"
+
+/**
+    Generator of screen distortion (SDM) warp meshes for fb::set_sdm_mesh.
+
+    A warp model maps normalized output screen coordinates (0..1) to the
+    source image texture coordinates and an edge blend alpha. Two models are
+    provided: an analytic radial/tangential lens (Brown-Conrady) and a
+    calibration grid with bilinear interpolation; projector/dome setups can
+    implement sdm_warp_model directly.
+
+    The mesh is a tensor-product grid with adaptive line placement: starting
+    from a coarse grid, column and row intervals are split where the linear
+    interpolation of the texture coordinates deviates from the model by more
+    than max_error. Splitting whole lines keeps the mesh free of T-junctions.
+    Model evaluation is spread across threads.
+
+    Results are quantized to the sdm_vertex layout and can be cached on disk,
+    keyed by a hash of the model calibration and generator parameters, so
+    multi-channel setups do not regenerate them at every startup.
+
+    Example:
+        ot::sdm_radial_lens lens;
+        lens.k1 = -0.12f;
+
+        ot::sdm_mesh mesh;
+        if (!mesh.load_cached("cache/sdm", lens, params)) {
+            mesh.generate(lens, params);
+            mesh.save_cached("cache/sdm", lens, params);
+        }
+        mesh.apply(ot::fb::get());
+**/
+
+namespace ot {
+
+////////////////////////////////////////////////////////////////////////////////
+///Warp model interface
+class sdm_warp_model
+{
+public:
+    virtual ~sdm_warp_model() {}
+
+    ///Evaluate the warp
+    //@param screen normalized output screen coordinates 0..1
+    //@param uv [out] source texture coordinates 0..1
+    //@param alpha [out] edge blend 0..1
+    //@note called concurrently from multiple threads
+    virtual void eval( const float2& screen, float2& uv, float& alpha ) const = 0;
+
+    //@return hash of the model calibration data, e.g. fnv1a of the coefficients
+    virtual uint64 hash() const = 0;
+};
+
+///Radial and tangential lens distortion (Brown-Conrady)
+class sdm_radial_lens : public sdm_warp_model
+{
+public:
+
+    float2 center = float2(0.5f);       //< distortion center in screen coordinates
+    float2 scale = float2(1.0f);        //< normalization of the screen coordinates around the center
+    float k1 = 0, k2 = 0, k3 = 0;       //< radial coefficients
+    float p1 = 0, p2 = 0;               //< tangential coefficients
+    float blend = 0.0f;                 //< width of the edge blend ramp in uv units
+
+    void eval( const float2& screen, float2& uv, float& alpha ) const override
+    {
+        float2 p = (screen - center) * scale;
+        float r2 = glm::dot(p, p);
+        float radial = 1 + r2 * (k1 + r2 * (k2 + r2 * k3));
+
+        float2 d;
+        d.x = p.x * radial + 2 * p1 * p.x * p.y + p2 * (r2 + 2 * p.x * p.x);
+        d.y = p.y * radial + p1 * (r2 + 2 * p.y * p.y) + 2 * p2 * p.x * p.y;
+
+        uv = d / scale + center;
+
+        //fade out towards the source image edges
+        float e = glm::min(glm::min(uv.x, 1 - uv.x), glm::min(uv.y, 1 - uv.y));
+        alpha = blend > 0
+            ? glm::clamp(e / blend, 0.0f, 1.0f)
+            : (e >= 0 ? 1.0f : 0.0f);
+    }
+
+    uint64 hash() const override {
+        float v[] = { center.x, center.y, scale.x, scale.y, k1, k2, k3, p1, p2, blend };
+        return fnv1a(v, sizeof(v), fnv1a("radial", 6));
+    }
+};
+
+///Calibration grid of measured uv and alpha values, bilinearly interpolated
+class sdm_grid_lens : public sdm_warp_model
+{
+public:
+
+    ///Set calibration data
+    //@param cols,rows grid dimensions, samples cover the screen uniformly including the edges
+    //@param uv texture coordinates, row-major
+    //@param alpha edge blend values, row-major, null for opaque
+    void set( uint cols, uint rows, const float2* uv, const float* alpha )
+    {
+        DASSERT(cols >= 2 && rows >= 2);
+        _cols = cols;
+        _rows = rows;
+
+        uint n = cols * rows;
+        _uv.resize(n);
+        _alpha.resize(n);
+        for (uint i = 0; i < n; ++i) {
+            _uv[i] = uv[i];
+            _alpha[i] = alpha ? alpha[i] : 1.0f;
+        }
+
+        _hash = fnv1a(_uv.ptr(), n * sizeof(float2), fnv1a(&_cols, sizeof(_cols), fnv1a(&_rows, sizeof(_rows))));
+        _hash = fnv1a(_alpha.ptr(), n * sizeof(float), _hash);
+    }
+
+    void eval( const float2& screen, float2& uv, float& alpha ) const override
+    {
+        float fx = glm::clamp(screen.x, 0.0f, 1.0f) * (_cols - 1);
+        float fy = glm::clamp(screen.y, 0.0f, 1.0f) * (_rows - 1);
+        uint x = glm::min(uint(fx), _cols - 2);
+        uint y = glm::min(uint(fy), _rows - 2);
+        fx -= x;
+        fy -= y;
+
+        uint i = y * _cols + x;
+        float2 u0 = glm::mix(_uv[i], _uv[i + 1], fx);
+        float2 u1 = glm::mix(_uv[i + _cols], _uv[i + _cols + 1], fx);
+        uv = glm::mix(u0, u1, fy);
+
+        float a0 = glm::mix(_alpha[i], _alpha[i + 1], fx);
+        float a1 = glm::mix(_alpha[i + _cols], _alpha[i + _cols + 1], fx);
+        alpha = glm::mix(a0, a1, fy);
+    }
+
+    uint64 hash() const override { return _hash; }
+
+private:
+
+    uint _cols = 0, _rows = 0;
+    coid::dynarray<float2> _uv;
+    coid::dynarray<float> _alpha;
+    uint64 _hash = 0;
+};
+
+///Mesh generator parameters
+struct sdm_mesh_params
+{
+    uint base_cols = 16;                //< initial number of column intervals
+    uint base_rows = 9;                 //< initial number of row intervals
+    uint max_level = 4;                 //< max number of interval halvings
+    float max_error = 0.25f / 1024;     //< max uv interpolation error
+    float2 fov = float2(0);             //< field of view passed to set_sdm_mesh
+    uint nthreads = 0;                  //< evaluation threads, 0 for hardware concurrency
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class sdm_mesh
+{
+public:
+
+    ///Generate mesh from warp model
+    void generate( const sdm_warp_model& model, const sdm_mesh_params& p )
+    {
+        _fov = p.fov;
+
+        //initial uniform lines
+        coid::dynarray<float> xs, ys;
+        uniform(xs, p.base_cols);
+        uniform(ys, p.base_rows);
+
+        coid::dynarray<float> cx, cy;
+        coid::dynarray<sample> grid;
+
+        for (uint level = 0; level < p.max_level; ++level)
+        {
+            //candidate grid with all interval midpoints
+            midpoints(xs, cx);
+            midpoints(ys, cy);
+            evaluate(model, cx, cy, grid, p.nthreads);
+
+            const uint ncx = uint(cx.size());
+            bool split = false;
+
+            //column intervals: compare midpoint samples on existing rows
+            _split_x.resize(xs.size() - 1);
+            for (uint i = 0; i + 1 < xs.size(); ++i) {
+                float err = 0;
+                for (uint j = 0; j < cy.size(); j += 2) {
+                    const sample* row = grid.ptr() + j * ncx;
+                    err = glm::max(err, deviation(row[2*i], row[2*i + 1], row[2*i + 2]));
+                }
+                _split_x[i] = err > p.max_error;
+                split |= _split_x[i] != 0;
+            }
+
+            //row intervals: compare midpoint samples on existing columns
+            _split_y.resize(ys.size() - 1);
+            for (uint j = 0; j + 1 < ys.size(); ++j) {
+                float err = 0;
+                for (uint i = 0; i < ncx; i += 2) {
+                    const sample* c = grid.ptr() + 2 * j * ncx + i;
+                    err = glm::max(err, deviation(c[0], c[ncx], c[2 * ncx]));
+                }
+                _split_y[j] = err > p.max_error;
+                split |= _split_y[j] != 0;
+            }
+
+            if (!split)
+                break;
+
+            refine(xs, _split_x);
+            refine(ys, _split_y);
+        }
+
+        evaluate(model, xs, ys, grid, p.nthreads);
+        build(xs, ys, grid);
+    }
+
+    ///Send the mesh to the framebuffer
+    void apply( const iref<fb>& fb ) const {
+        fb->set_sdm_mesh(_vertices.ptr(), uint(_vertices.size()), _indices.ptr(), uint(_indices.size()), _fov);
+    }
+
+    const coid::dynarray<sdm_vertex>& vertices() const { return _vertices; }
+    const coid::dynarray<uint>& indices() const { return _indices; }
+
+    //@return cache key for the model and parameters
+    static uint64 cache_key( const sdm_warp_model& model, const sdm_mesh_params& p )
+    {
+        uint64 h = model.hash();
+        uint v[] = { p.base_cols, p.base_rows, p.max_level, VERSION };
+        float f[] = { p.max_error, p.fov.x, p.fov.y };
+        h = fnv1a(v, sizeof(v), h);
+        return fnv1a(f, sizeof(f), h);
+    }
+
+    ///Load mesh from the disk cache
+    //@return false if not cached or the cache file is invalid (size not matching the header,
+    /// indices out of the vertex range)
+    bool load_cached( const coid::token& dir, const sdm_warp_model& model, const sdm_mesh_params& p )
+    {
+        uint64 key = cache_key(model, p);
+        FILE* f = fopen(cache_path(dir, key).c_str(), "rb");
+        if (!f)
+            return false;
+
+        fseek(f, 0, SEEK_END);
+        long fsize = ftell(f);
+        fseek(f, 0, SEEK_SET);
+
+        header h;
+        bool ok = fsize >= long(sizeof(h))
+            && fread(&h, sizeof(h), 1, f) == 1
+            && h.magic == MAGIC && h.version == VERSION && h.key == key
+            && h.nindices % 3 == 0
+            && uint64(fsize) == sizeof(h) + uint64(h.nvertices) * sizeof(sdm_vertex) + uint64(h.nindices) * sizeof(uint);
+
+        if (ok) {
+            _vertices.resize(h.nvertices);
+            _indices.resize(h.nindices);
+            ok = fread(_vertices.ptr(), sizeof(sdm_vertex), h.nvertices, f) == h.nvertices
+                && fread(_indices.ptr(), sizeof(uint), h.nindices, f) == h.nindices;
+            _fov = h.fov;
+        }
+
+        fclose(f);
+
+        for (uint i = 0; ok && i < h.nindices; ++i)
+            ok = _indices[i] < h.nvertices;
+
+        if (!ok) {
+            _vertices.reset();
+            _indices.reset();
+        }
+        return ok;
+    }
+
+    ///Store mesh into the disk cache
+    bool save_cached( const coid::token& dir, const sdm_warp_model& model, const sdm_mesh_params& p ) const
+    {
+        uint64 key = cache_key(model, p);
+        FILE* f = fopen(cache_path(dir, key).c_str(), "wb");
+        if (!f)
+            return false;
+
+        header h;
+        h.magic = MAGIC;
+        h.version = VERSION;
+        h.key = key;
+        h.nvertices = uint(_vertices.size());
+        h.nindices = uint(_indices.size());
+        h.fov = _fov;
+
+        bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+            && fwrite(_vertices.ptr(), sizeof(sdm_vertex), h.nvertices, f) == h.nvertices
+            && fwrite(_indices.ptr(), sizeof(uint), h.nindices, f) == h.nindices;
+
+        fclose(f);
+        return ok;
+    }
+
+private:
+
+    enum {
+        MAGIC = 0x31736473,             //< 'sds1'
+        VERSION = 1,
+    };
+
+    struct header
+    {
+        uint magic;
+        uint version;
+        uint64 key;
+        uint nvertices;
+        uint nindices;
+        float2 fov;
+    };
+
+    struct sample
+    {
+        float2 uv;
+        float alpha;
+    };
+
+    static coid::charstr cache_path( const coid::token& dir, uint64 key ) {
+        char name[32];
+        snprintf(name, sizeof(name), "/sdm_%016llx.bin", (unsigned long long)key);
+        coid::charstr path = dir;
+        path << name;
+        return path;
+    }
+
+    static void uniform( coid::dynarray<float>& v, uint n ) {
+        n = n ? n : 1;
+        v.resize(n + 1);
+        for (uint i = 0; i <= n; ++i)
+            v[i] = float(i) / n;
+    }
+
+    ///Lines with interval midpoints inserted
+    static void midpoints( const coid::dynarray<float>& v, coid::dynarray<float>& out ) {
+        uint n = uint(v.size());
+        out.resize(2 * n - 1);
+        for (uint i = 0; i + 1 < n; ++i) {
+            out[2*i] = v[i];
+            out[2*i + 1] = 0.5f * (v[i] + v[i + 1]);
+        }
+        out[2 * n - 2] = v[n - 1];
+    }
+
+    ///Split flagged intervals
+    static void refine( coid::dynarray<float>& v, const coid::dynarray<uint8>& split ) {
+        coid::dynarray<float> out;
+        for (uint i = 0; i + 1 < v.size(); ++i) {
+            *out.add() = v[i];
+            if (split[i])
+                *out.add() = 0.5f * (v[i] + v[i + 1]);
+        }
+        *out.add() = v.last();
+        v.swap(out);
+    }
+
+    //@return uv deviation of the midpoint sample from the linear interpolation
+    static float deviation( const sample& a, const sample& m, const sample& b ) {
+        float2 d = m.uv - 0.5f * (a.uv + b.uv);
+        return glm::max(fabsf(d.x), fabsf(d.y));
+    }
+
+    ///Evaluate model on the grid, rows split across threads
+    static void evaluate( const sdm_warp_model& model, const coid::dynarray<float>& xs, const coid::dynarray<float>& ys,
+        coid::dynarray<sample>& grid, uint nthreads )
+    {
+        const uint nx = uint(xs.size());
+        const uint ny = uint(ys.size());
+        grid.resize(nx * ny);
+
+        auto rows = [&](uint y0, uint y1) {
+            for (uint y = y0; y < y1; ++y) {
+                sample* s = grid.ptr() + y * nx;
+                for (uint x = 0; x < nx; ++x)
+                    model.eval(float2(xs[x], ys[y]), s[x].uv, s[x].alpha);
+            }
+        };
+
+        uint nt = nthreads ? nthreads : std::thread::hardware_concurrency();
+        if (nt > ny)
+            nt = ny;
+        if (nt <= 1 || nx * ny < 4096) {
+            rows(0, ny);
+            return;
+        }
+
+        std::thread* threads = new std::thread[nt - 1];
+        uint per = (ny + nt - 1) / nt;
+        for (uint t = 1; t < nt; ++t) {
+            uint y0 = glm::min(t * per, ny);
+            uint y1 = glm::min(y0 + per, ny);
+            threads[t - 1] = std::thread(rows, y0, y1);
+        }
+
+        rows(0, glm::min(per, ny));
+
+        for (uint t = 0; t + 1 < nt; ++t)
+            threads[t].join();
+        delete[] threads;
+    }
+
+    ///Quantize into sdm_vertex layout and build the triangle list
+    void build( const coid::dynarray<float>& xs, const coid::dynarray<float>& ys, const coid::dynarray<sample>& grid )
+    {
+        const uint nx = uint(xs.size());
+        const uint ny = uint(ys.size());
+
+        _vertices.resize(nx * ny);
+        for (uint y = 0; y < ny; ++y) {
+            for (uint x = 0; x < nx; ++x) {
+                const sample& s = grid[y * nx + x];
+                sdm_vertex& v = _vertices[y * nx + x];
+
+                //screen position in -1..1
+                v._vtx = float2(xs[x] * 2 - 1, ys[y] * 2 - 1);
+
+                float2 uv = glm::clamp(s.uv, float2(0), float2(1));
+                v._uv = ushort2(uint16(uv.x * 65535 + 0.5f), uint16(uv.y * 65535 + 0.5f));
+
+                //alpha replicated into all four 8-bit channels
+                uint a = uint(glm::clamp(s.alpha, 0.0f, 1.0f) * 255 + 0.5f);
+                v._alpha = a * 0x01010101U;
+            }
+        }
+
+        _indices.resize(6 * (nx - 1) * (ny - 1));
+        uint* idx = _indices.ptr();
+        for (uint y = 0; y + 1 < ny; ++y) {
+            for (uint x = 0; x + 1 < nx; ++x) {
+                uint i = y * nx + x;
+                idx[0] = i;      idx[1] = i + 1;      idx[2] = i + nx;
+                idx[3] = i + 1;  idx[4] = i + nx + 1; idx[5] = i + nx;
+                idx += 6;
+            }
+        }
+    }
+
+private:
+
+    coid::dynarray<sdm_vertex> _vertices;
+    coid::dynarray<uint> _indices;
+    float2 _fov = float2(0);
+
+    coid::dynarray<uint8> _split_x, _split_y;
+};
+
+} //namespace ot
+
+#endif //__OT_SDM_MESH_H__
@@ -0,0 +1,539 @@
+#pragma once
+#ifndef __OT_TEXT_LAYOUT_H__
+#define __OT_TEXT_LAYOUT_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+#include <comm/range.h>
+#include <comm/token.h>
+
+#include "canvas_cmd.h"
+#include "fnv_hash.h"
+
+/**
+    Retained text layout for canvas text.
+
+    Text is laid out plugin-side using BMFont metrics (the same .fnt files
+    that canvas::load_font uses), split into lines and positioned in the
+    box according to the anchor flags. Each line is then emitted as a single
+    draw_text call at its final position, which gives correct anchored
+    multi-line output without relying on draw_text_wh.
+
+    text_label keeps the layout of one label between frames. When the text
+    changes, only the changed byte range is re-measured: if it stays within
+    a single line, the line width is adjusted by the advance difference and
+    only that line is repositioned (typical for numeric readouts).
+
+    text_layout_cache keeps layouts of immediate-mode labels keyed by
+    (font, box, anchor, text) and evicts entries not used for a number of
+    frames. Lookup goes by hash, the text bytes are compared before reuse.
+
+    Example:
+        ot::font_metrics fm;
+        fm.parse(fnt_file_content);
+        const uint fnt = cnv->load_font("ui/default.fnt");
+
+        ot::text_label alt(fnt, &fm, ot::text_box(10, 10, 80, 20, ot::ANCHOR_RIGHT | ot::ANCHOR_VCENTER));
+        alt.set_text(altitude_str);
+        alt.emit(cmdbuf, u8vec4(0, 0xff, 0, 0xff));
+**/
+
+namespace ot {
+
+///Anchor flags, same as canvas::draw_text_wh
+enum ETextAnchor {
+    ANCHOR_LEFT         = 0x01,
+    ANCHOR_HCENTER      = 0x02,
+    ANCHOR_RIGHT        = 0x03,
+    ANCHOR_BOTTOM       = 0x10,
+    ANCHOR_VCENTER      = 0x20,
+    ANCHOR_TOP          = 0x30,
+
+    ANCHOR_HMASK        = 0x0f,
+    ANCHOR_VMASK        = 0xf0,
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///Font metrics parsed from BMFont text format
+struct font_metrics
+{
+    float line_height = 0;
+    float base = 0;
+    float default_advance = 0;          //< advance of characters missing in the font
+    float advance[256];                 //< advance of code points 0..255
+
+    font_metrics() {
+        for (uint i = 0; i < 256; ++i)
+            advance[i] = 0;
+    }
+
+    ///Parse BMFont text descriptor
+    //@return false if the descriptor contains no characters
+    bool parse( coid::token fnt )
+    {
+        uint nchars = 0;
+        float sum = 0;
+
+        while (fnt) {
+            coid::token line = fnt.get_line();
+            coid::token tag = line.cut_left(' ');
+
+            if (tag == "common") {
+                line_height = value(line, "lineHeight");
+                base = value(line, "base");
+            }
+            else if (tag == "char") {
+                uint id = uint(value(line, "id"));
+                float adv = value(line, "xadvance");
+                if (id < 256)
+                    advance[id] = adv;
+                sum += adv;
+                ++nchars;
+            }
+        }
+
+        default_advance = nchars ? sum / nchars : 0;
+        return nchars > 0;
+    }
+
+    //@return advance of given code point
+    float get_advance( uint cp ) const {
+        return cp < 256 ? advance[cp] : default_advance;
+    }
+
+    ///Measure text up to the first line break
+    float width( const char* p, const char* pe ) const
+    {
+        float w = 0;
+        while (p < pe && *p != '\n')
+            w += get_advance(decode(p, pe));
+        return w;
+    }
+
+    ///Decode UTF-8 code point and advance the pointer
+    static uint decode( const char*& p, const char* pe )
+    {
+        uint c = uint8(*p++);
+        if (c < 0x80)
+            return c;
+
+        uint n = c >= 0xf0 ? 3 : (c >= 0xe0 ? 2 : 1);
+        c &= 0x3f >> n;
+        for (; n > 0 && p < pe; --n)
+            c = (c << 6) | (uint8(*p++) & 0x3f);
+        return c;
+    }
+
+private:
+
+    static float value( coid::token line, const coid::token& key )
+    {
+        while (line) {
+            coid::token kv = line.cut_left(' ');
+            coid::token k = kv.cut_left('=');
+            if (k == key)
+                return float(kv.toint());
+        }
+        return 0;
+    }
+};
+
+///Layout box
+struct text_box
+{
+    float x = 0, y = 0, w = 0, h = 0;
+    uint anchor = ANCHOR_LEFT | ANCHOR_TOP;
+
+    text_box() {}
+    text_box( float x, float y, float w, float h, uint anchor )
+        : x(x), y(y), w(w), h(h), anchor(anchor)
+    {}
+
+    bool operator == ( const text_box& b ) const {
+        return x == b.x && y == b.y && w == b.w && h == b.h && anchor == b.anchor;
+    }
+};
+
+///Laid out text line
+struct text_line
+{
+    uint offset;                        //< byte offset of the line in the text
+    uint len;                           //< byte length of the line
+    float width;                        //< measured width
+    float2 pos;                         //< line origin passed to draw_text
+};
+
+///Compute horizontal line origin for the anchor
+inline float text_line_x( const text_box& box, float width )
+{
+    switch (box.anchor & ANCHOR_HMASK) {
+    case ANCHOR_HCENTER: return box.x + (box.w - width) * 0.5f;
+    case ANCHOR_RIGHT:   return box.x + box.w - width;
+    default:             return box.x;
+    }
+}
+
+///Lay out text into lines
+//@param bottom_left true if the canvas y axis points up
+inline void text_layout_lines( const font_metrics& fm, const text_box& box, bool bottom_left,
+    const char* text, uint len, coid::dynarray<text_line>& lines )
+{
+    lines.reset();
+
+    const char* p = text;
+    const char* pe = text + len;
+    for (;;) {
+        const char* e = p;
+        while (e < pe && *e != '\n')
+            ++e;
+
+        text_line* l = lines.add();
+        l->offset = uint(p - text);
+        l->len = uint(e - p);
+        l->width = fm.width(p, e);
+
+        if (e >= pe)
+            break;
+        p = e + 1;
+    }
+
+    float lh = fm.line_height;
+    float total = lh * lines.size();
+
+    //distance of the first line top from the box top
+    float top;
+    switch (box.anchor & ANCHOR_VMASK) {
+    case ANCHOR_BOTTOM:  top = box.h - total; break;
+    case ANCHOR_VCENTER: top = (box.h - total) * 0.5f; break;
+    default:             top = 0; break;
+    }
+
+    for (uint i = 0; i < lines.size(); ++i) {
+        text_line& l = lines[i];
+        float dy = top + lh * i;
+        l.pos.x = text_line_x(box, l.width);
+        l.pos.y = bottom_left
+            ? box.y + box.h - dy - lh
+            : box.y + dy;
+    }
+}
+
+///Emit laid out lines as draw_text commands
+inline void text_emit_lines( canvas_cmdbuf& cb, uint font, const char* text,
+    const text_line* lines, uint nlines, const u8vec4& color )
+{
+    for (uint i = 0; i < nlines; ++i) {
+        const text_line& l = lines[i];
+        if (!l.len)
+            continue;
+
+        const char* p = text + l.offset;
+        cb.draw_text(font, l.pos.x, l.pos.y, coid::token(p, p + l.len), color);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///Retained text label with incremental relayout
+class text_label
+{
+public:
+
+    text_label( uint font, const font_metrics* fm, const text_box& box, bool bottom_left = true )
+        : _font(font), _fm(fm), _box(box), _bottom_left(bottom_left)
+    {}
+
+    void set_box( const text_box& box ) {
+        if (box == _box)
+            return;
+        _box = box;
+        relayout();
+    }
+
+    ///Set label text, re-measuring only the changed part when possible
+    //@return true if the text changed
+    bool set_text( const coid::token& text )
+    {
+        uint n = uint(text.len());
+        uint on = uint(_text.size());
+        const char* s = text.ptr();
+
+        if (n == on && ::memcmp(s, _text.ptr(), n) == 0)
+            return false;
+
+        if (n != on || !_lines.size() || !incremental(s, n)) {
+            _text.reset();
+            ::memcpy(_text.add(n), s, n);
+            relayout();
+        }
+        return true;
+    }
+
+    ///Emit draw commands for the label
+    void emit( canvas_cmdbuf& cb, const u8vec4& color ) const {
+        text_emit_lines(cb, _font, _text.ptr(), _lines.ptr(), uint(_lines.size()), color);
+    }
+
+    const coid::dynarray<text_line>& lines() const { return _lines; }
+
+    //@return number of full relayouts, for diagnostics
+    uint relayouts() const { return _relayouts; }
+
+private:
+
+    void relayout() {
+        text_layout_lines(*_fm, _box, _bottom_left, _text.ptr(), uint(_text.size()), _lines);
+        ++_relayouts;
+    }
+
+    ///Update layout for a text of the same length differing within a single line
+    bool incremental( const char* s, uint n )
+    {
+        char* old = _text.ptr();
+
+        uint a = 0;
+        while (old[a] == s[a])
+            ++a;
+        uint b = n - 1;
+        while (old[b] == s[b])
+            --b;
+
+        //extend to whole UTF-8 sequences
+        while (a > 0 && ((uint8(s[a]) & 0xc0) == 0x80 || (uint8(old[a]) & 0xc0) == 0x80))
+            --a;
+        while (b + 1 < n && ((uint8(s[b+1]) & 0xc0) == 0x80 || (uint8(old[b+1]) & 0xc0) == 0x80))
+            ++b;
+
+        for (uint i = a; i <= b; ++i)
+            if (s[i] == '\n' || old[i] == '\n')
+                return false;
+
+        //find the line containing the change
+        uint li = 0;
+        while (li + 1 < _lines.size() && _lines[li + 1].offset <= a)
+            ++li;
+
+        text_line& l = _lines[li];
+        float delta = _fm->width(s + a, s + b + 1) - _fm->width(old + a, old + b + 1);
+
+        ::memcpy(old + a, s + a, b + 1 - a);
+
+        if (delta != 0) {
+            l.width += delta;
+            l.pos.x = text_line_x(_box, l.width);
+        }
+        return true;
+    }
+
+private:
+
+    uint _font;
+    const font_metrics* _fm;
+    text_box _box;
+    bool _bottom_left;
+
+    coid::dynarray<char> _text;
+    coid::dynarray<text_line> _lines;
+    uint _relayouts = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///Cache of text layouts for immediate-mode labels
+class text_layout_cache
+{
+public:
+
+    //@param bottom_left true if the canvas y axis points up
+    //@param max_age frames after which unused entries are evicted
+    explicit text_layout_cache( bool bottom_left = true, uint max_age = 60 )
+        : _bottom_left(bottom_left)
+        , _max_age(max_age)
+    {
+        _table.resize(256);
+        ::memset(_table.ptr(), 0xff, _table.size() * sizeof(uint));
+    }
+
+    ///Register font metrics for a canvas font handle
+    void set_font( uint font, const font_metrics* fm ) {
+        if (font >= _fonts.size()) {
+            uint n = uint(_fonts.size());
+            _fonts.resize(font + 1);
+            for (uint i = n; i < font; ++i)
+                _fonts[i] = 0;
+        }
+        _fonts[font] = fm;
+    }
+
+    ///Lay out text using the cache and emit draw commands
+    void draw( canvas_cmdbuf& cb, uint font, const text_box& box, const coid::token& text, const u8vec4& color )
+    {
+        const entry& e = get(font, box, text);
+        text_emit_lines(cb, font, text.ptr(), _lines.ptr() + e.first, e.count, color);
+    }
+
+    ///Get cached layout
+    //@return laid out lines, valid until the next call
+    coid::range<text_line> layout( uint font, const text_box& box, const coid::token& text )
+    {
+        const entry& e = get(font, box, text);
+        return coid::range<text_line>(_lines.ptr() + e.first, _lines.ptr() + e.first + e.count);
+    }
+
+    ///Advance frame counter and evict stale entries, call once per frame
+    void frame()
+    {
+        ++_frame;
+        if (_frame % 16)
+            return;
+
+        uint n = uint(_entries.size());
+        bool evicted = false;
+        for (uint i = 0; i < n; ++i) {
+            if (_frame - _entries[i].frame > _max_age) {
+                _entries[i].count = 0;
+                _entries[i].frame = 0;
+                _entries[i].hash = 0;
+                evicted = true;
+            }
+        }
+
+        if (evicted)
+            compact();
+    }
+
+    uint hits() const { return _hits; }
+    uint misses() const { return _misses; }
+
+private:
+
+    struct entry
+    {
+        uint64 hash;                    //< hash of font, box and text
+        uint font;
+        text_box box;
+        uint text;                      //< offset of the text in _text
+        uint textlen;                   //< text length
+        uint first;                     //< first line in _lines
+        uint count;                     //< number of lines
+        uint frame;                     //< last use
+    };
+
+    static uint64 hash( uint font, const text_box& box, const coid::token& text )
+    {
+        uint64 h = fnv1a(&font, sizeof(font));
+        h = fnv1a(&box.x, 4 * sizeof(float), h);
+        h = fnv1a(&box.anchor, sizeof(box.anchor), h);
+        h = fnv1a(text.ptr(), text.len(), h);
+        return h | 1;
+    }
+
+    const entry& get( uint font, const text_box& box, const coid::token& text )
+    {
+        uint64 h = hash(font, box, text);
+        uint mask = uint(_table.size()) - 1;
+
+        uint slot = uint(h) & mask;
+        for (;; slot = (slot + 1) & mask) {
+            uint ei = _table[slot];
+            if (ei == UMAX32)
+                break;
+
+            //cached line offsets index into the text, so it must match exactly
+            entry& e = _entries[ei];
+            if (e.hash == h && e.font == font && e.box == box
+                && e.textlen == text.len() && ::memcmp(_text.ptr() + e.text, text.ptr(), e.textlen) == 0) {
+                e.frame = _frame;
+                ++_hits;
+                return e;
+            }
+        }
+
+        ++_misses;
+
+        const font_metrics* fm = font < _fonts.size() ? _fonts[font] : 0;
+        DASSERT(fm);
+
+        text_layout_lines(*fm, box, _bottom_left, text.ptr(), uint(text.len()), _tmp);
+
+        entry* e = _entries.add();
+        e->hash = h;
+        e->font = font;
+        e->box = box;
+        e->text = uint(_text.size());
+        e->textlen = uint(text.len());
+        e->first = uint(_lines.size());
+        e->count = uint(_tmp.size());
+        e->frame = _frame;
+        ::memcpy(_lines.add(_tmp.size()), _tmp.ptr(), _tmp.size() * sizeof(text_line));
+        ::memcpy(_text.add(text.len()), text.ptr(), text.len());
+
+        _table[slot] = uint(_entries.size() - 1);
+
+        if (_entries.size() * 2 > _table.size())
+            rehash(uint(_table.size()) * 2);
+
+        return _entries[_entries.size() - 1];
+    }
+
+    ///Drop evicted entries, their lines and texts
+    void compact()
+    {
+        uint ne = 0, nl = 0, nt = 0;
+        for (uint i = 0; i < _entries.size(); ++i) {
+            entry e = _entries[i];
+            if (!e.hash)
+                continue;
+
+            ::memmove(_lines.ptr() + nl, _lines.ptr() + e.first, e.count * sizeof(text_line));
+            e.first = nl;
+            nl += e.count;
+
+            ::memmove(_text.ptr() + nt, _text.ptr() + e.text, e.textlen);
+            e.text = nt;
+            nt += e.textlen;
+
+            _entries[ne++] = e;
+        }
+
+        _entries.resize(ne);
+        _lines.resize(nl);
+        _text.resize(nt);
+        rehash(uint(_table.size()));
+    }
+
+    void rehash( uint size )
+    {
+        _table.resize(size);
+        ::memset(_table.ptr(), 0xff, size * sizeof(uint));
+
+        uint mask = size - 1;
+        for (uint i = 0; i < _entries.size(); ++i) {
+            uint slot = uint(_entries[i].hash) & mask;
+            while (_table[slot] != UMAX32)
+                slot = (slot + 1) & mask;
+            _table[slot] = i;
+        }
+    }
+
+private:
+
+    bool _bottom_left;
+    uint _max_age;
+    uint _frame = 1;
+
+    coid::dynarray<const font_metrics*> _fonts;     //< metrics by canvas font handle
+    coid::dynarray<entry> _entries;
+    coid::dynarray<text_line> _lines;               //< lines of all entries
+    coid::dynarray<char> _text;                     //< texts of all entries
+    coid::dynarray<uint> _table;                    //< open addressing table of entry indices
+    coid::dynarray<text_line> _tmp;
+
+    uint _hits = 0;
+    uint _misses = 0;
+};
+
+} //namespace ot
+
+#endif //__OT_TEXT_LAYOUT_H__
@@ -0,0 +1,325 @@
+#pragma once
+#ifndef __OT_THERMAL_AUTOGAIN_H__
+#define __OT_THERMAL_AUTOGAIN_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+
+#include <immintrin.h>
+
+#include "fb.h"
+#include "glm/glm_ext.h"
+
+/**
+    Thermal histogram analytics and plugin-side auto-gain for the IR sensor.
+
+    thermal_histogram takes the histogram returned by
+    fb::get_temperature_histogram and builds its cumulative distribution
+    with an SSE prefix sum, along with a temperature-weighted prefix. Any
+    percentile, the mean and the pixel fraction and mean temperature of any
+    temperature band are then O(log n) or O(1) queries, without another
+    readback of the frame.
+
+    thermal_autogain is a closed loop replacing the host auto-gain: every
+    frame it maps the low/high percentiles of the scene temperature to the
+    sensor black/white points with temporal smoothing, and shifts the
+    black/white window by an integrated bias so that the mean scene
+    temperature converges to the target level within it. The results are
+    applied through fb::set_thermal_params and fb::set_ir_params.
+
+    fb::get_temperature_histogram returns only the bin counts, the bin
+    count and temperature range are not reported by the host. They must be
+    passed in thermal_histogram_params to match the host configuration.
+
+    Example:
+        //layout of the histogram as configured on the host
+        ot::thermal_histogram_params hp(nbins, temp_lo, temp_hi);
+        ot::thermal_autogain ag(ot::fb::get(), hp);
+        ag.set_environment(air_temp, water_temp, 0.5f);
+
+        //each frame
+        ag.update(dt);
+        const ot::thermal_histogram& h = ag.histogram();
+        float hot = h.band_fraction(target_temp - 2, target_temp + 2);
+**/
+
+namespace ot {
+
+///Layout of the host temperature histogram, must match the host configuration
+struct thermal_histogram_params
+{
+    uint bins;                          //< number of histogram bins
+    float temp_min;                     //< temperature of the lower edge of the first bin [C]
+    float temp_max;                     //< temperature of the upper edge of the last bin [C]
+
+    thermal_histogram_params( uint bins, float temp_min, float temp_max )
+        : bins(bins), temp_min(temp_min), temp_max(temp_max)
+    {
+        DASSERT(bins > 0 && temp_max > temp_min);
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class thermal_histogram
+{
+public:
+
+    explicit thermal_histogram( const thermal_histogram_params& p )
+        : _params(p)
+    {
+        uint n = (p.bins + 3) & ~3U;
+        _cdf.resize(n + 1);
+        _wcdf.resize(n + 1);
+        _cdf[0] = 0;
+        _wcdf[0] = 0;
+    }
+
+    const thermal_histogram_params& params() const { return _params; }
+
+    ///Build the cumulative distributions from a host histogram
+    //@param hist histogram with params().bins entries
+    void update( const uint* hist )
+    {
+        const uint nb = _params.bins;
+        uint* cdf = _cdf.ptr() + 1;
+
+        //SSE prefix sum, 4 bins at a time
+        __m128i carry = _mm_setzero_si128();
+        uint i = 0;
+        for (; i + 4 <= nb; i += 4) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(hist + i));
+            x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+            x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+            x = _mm_add_epi32(x, carry);
+            _mm_storeu_si128((__m128i*)(cdf + i), x);
+            carry = _mm_shuffle_epi32(x, 0xff);
+        }
+
+        uint sum = i ? cdf[i - 1] : 0;
+        for (; i < nb; ++i)
+            cdf[i] = sum += hist[i];
+
+        //temperature weighted prefix, in bin units to stay exact
+        uint64* wcdf = _wcdf.ptr() + 1;
+        uint64 wsum = 0;
+        for (i = 0; i < nb; ++i)
+            wcdf[i] = wsum += uint64(hist[i]) * i;
+
+        _total = nb ? cdf[nb - 1] : 0;
+    }
+
+    //@return number of pixels in the histogram
+    uint total() const { return _total; }
+
+    //@return temperature below which given fraction of pixels lies
+    //@param p fraction 0..1
+    float percentile( float p ) const
+    {
+        if (!_total)
+            return _params.temp_min;
+
+        const uint nb = _params.bins;
+        float target = p * _total;
+
+        //first bin whose cumulative count reaches the target
+        const uint* cdf = _cdf.ptr();
+        uint lo = 0, hi = nb;
+        while (lo < hi) {
+            uint mid = (lo + hi) >> 1;
+            if (float(cdf[mid + 1]) < target)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        if (lo >= nb)
+            return _params.temp_max;
+
+        //linear interpolation within the bin
+        uint c0 = cdf[lo];
+        uint c1 = cdf[lo + 1];
+        float f = c1 > c0 ? (target - c0) / float(c1 - c0) : 0.5f;
+        return bin_temp(lo + glm::clamp(f, 0.0f, 1.0f));
+    }
+
+    //@return mean temperature
+    float mean() const {
+        return _total ? bin_temp(0.5f + float(double(_wcdf[_params.bins]) / _total)) : _params.temp_min;
+    }
+
+    //@return fraction of pixels with temperature within the band
+    float band_fraction( float t0, float t1 ) const
+    {
+        if (!_total)
+            return 0;
+        uint b0, b1;
+        band_bins(t0, t1, b0, b1);
+        return float(_cdf[b1] - _cdf[b0]) / _total;
+    }
+
+    //@return mean temperature of pixels within the band, or the band center if empty
+    float band_mean( float t0, float t1 ) const
+    {
+        uint b0, b1;
+        band_bins(t0, t1, b0, b1);
+        uint n = _cdf[b1] - _cdf[b0];
+        if (!n)
+            return 0.5f * (t0 + t1);
+        return bin_temp(0.5f + float(double(_wcdf[b1] - _wcdf[b0]) / n));
+    }
+
+    //@return temperature at given fractional bin position
+    float bin_temp( float bin ) const {
+        return _params.temp_min + bin * (_params.temp_max - _params.temp_min) / _params.bins;
+    }
+
+private:
+
+    ///Convert temperature band to the [b0, b1) range of cdf indices
+    void band_bins( float t0, float t1, uint& b0, uint& b1 ) const
+    {
+        float k = _params.bins / (_params.temp_max - _params.temp_min);
+        float f0 = (t0 - _params.temp_min) * k;
+        float f1 = (t1 - _params.temp_min) * k;
+        b0 = uint(glm::clamp(f0, 0.0f, float(_params.bins)));
+        b1 = uint(glm::clamp(ceilf(f1), 0.0f, float(_params.bins)));
+        if (b1 < b0)
+            b1 = b0;
+    }
+
+    thermal_histogram_params _params;
+
+    coid::dynarray<uint> _cdf;          //< _cdf[i] = pixels in bins < i
+    coid::dynarray<uint64> _wcdf;       //< _wcdf[i] = sum of bin index * count for bins < i
+    uint _total = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class thermal_autogain
+{
+public:
+
+    ///Loop configuration
+    struct params
+    {
+        float low_percentile = 0.02f;   //< scene fraction mapped below black
+        float high_percentile = 0.98f;  //< scene fraction mapped above white
+        float min_span = 5.0f;          //< minimal black-white span [C]
+        float time_constant = 0.5f;     //< smoothing of the black/white points [s]
+
+        float target_level = 0.5f;      //< target mean level in the black-white range
+        float level_gain = 1.0f;        //< level loop gain [1/s]
+        float max_bias = 0.5f;          //< max window shift, fraction of the span
+
+        float contrast = 1.0f;          //< passed to set_ir_params
+        float amplify = 1.0f;           //< passed to set_ir_params
+        float noise = 0.02f;            //< passed to set_ir_params
+    };
+
+    //@param hp layout of the host temperature histogram
+    thermal_autogain( const iref<fb>& fb, const thermal_histogram_params& hp )
+        : thermal_autogain(fb, hp, params())
+    {}
+
+    thermal_autogain( const iref<fb>& fb, const thermal_histogram_params& hp, const params& p )
+        : _fb(fb)
+        , _params(p)
+        , _hist(hp)
+    {
+        _fb->enable_thermal_autogain(false);
+    }
+
+    params& get_params() { return _params; }
+
+    ///Set the environment temperatures passed to set_thermal_params
+    void set_environment( float air_temperature, float water_temperature, float air_temperature_daytime_coef ) {
+        _air = air_temperature;
+        _water = water_temperature;
+        _daytime_coef = air_temperature_daytime_coef;
+    }
+
+    ///Read the histogram and update the sensor parameters
+    //@param dt time step [s]
+    void update( float dt )
+    {
+        const uint* h = _fb->get_temperature_histogram();
+        if (!h)
+            return;
+
+        _hist.update(h);
+        if (!_hist.total())
+            return;
+
+        float lo = _hist.percentile(_params.low_percentile);
+        float hi = _hist.percentile(_params.high_percentile);
+
+        //keep a minimal span around the middle
+        if (hi - lo < _params.min_span) {
+            float mid = 0.5f * (lo + hi);
+            lo = mid - 0.5f * _params.min_span;
+            hi = mid + 0.5f * _params.min_span;
+        }
+
+        if (!_initialized) {
+            _black = lo;
+            _white = hi;
+            _initialized = true;
+        }
+        else {
+            float k = _params.time_constant > 0 ? 1.0f - expf(-dt / _params.time_constant) : 1.0f;
+            _black += (lo - _black) * k;
+            _white += (hi - _white) * k;
+        }
+
+        //shift the window so that the mean level reaches the target
+        float span = _white - _black;
+        _level = (_hist.mean() - _black - _bias) / span;
+        _bias += (_level - _params.target_level) * span * _params.level_gain * dt;
+
+        float maxb = _params.max_bias * span;
+        _bias = glm::clamp(_bias, -maxb, maxb);
+
+        _fb->set_thermal_params(_black + _bias, _white + _bias, _air, _water, _daytime_coef);
+        _fb->set_ir_params(_params.contrast, _params.amplify, _params.noise);
+    }
+
+    ///Release control back to the host auto-gain
+    void release() {
+        _fb->enable_thermal_autogain(true);
+        _initialized = false;
+        _bias = 0;
+    }
+
+    const thermal_histogram& histogram() const { return _hist; }
+
+    //@{ current sensor black/white points [C]
+    float black() const { return _black + _bias; }
+    float white() const { return _white + _bias; }
+    //@}
+
+    //@return mean scene level in the black-white range
+    float level() const { return _level; }
+
+private:
+
+    iref<fb> _fb;
+    params _params;
+    thermal_histogram _hist;
+
+    float _air = 15.0f;
+    float _water = 10.0f;
+    float _daytime_coef = 0.5f;
+
+    float _black = 0;
+    float _white = 0;
+    float _bias = 0;                    //< window shift of the level loop
+    float _level = 0;
+    bool _initialized = false;
+};
+
+} //namespace ot
+
+#endif //__OT_THERMAL_AUTOGAIN_H__
@@ -0,0 +1,373 @@
+#pragma once
+#ifndef __OT_TRACER_POOL_H__
+#define __OT_TRACER_POOL_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+#include <comm/range.h>
+
+#include <bit>
+
+#include "explosions.h"
+
+/**
+    Client-side tracer pool on top of ot::explosions.
+
+    Tracers are launched in batches from tracer_desc arrays, every batch gets
+    a contiguous range of pool ids. Pool id modulo the capacity is the slot
+    index; a batch takes the first run of free slots found from the last
+    allocation on, skipping slots still held by long-lived tracers. The
+    pool passes its own id as the tracer
+    uservalue to the host, so that landed tracers can be mapped back to the
+    pool slot in O(1) without any lookup tables; the original uservalue and
+    entid are restored from the slot.
+
+    Impacts are read from explosions::landed_tracers() once per frame in
+    poll() and routed into impact channels. Each channel is a ring buffer
+    with a filter on uservalue and/or entid, readers keep a cursor and get
+    views into the ring with the impacts added since their last read.
+
+    Example:
+        ot::tracer_pool pool(ot::explosions::get());
+        uint ch = pool.add_channel(MY_WEAPON_ID);
+
+        ot::tracer_range r = pool.launch_tracers(coid::range<ot::tracer_desc>(descs, descs + n));
+        ...
+        pool.poll(dt);                                  //once per frame
+
+        uint64 cursor = 0;
+        ot::impact_view v = pool.impacts(ch, cursor);
+        for (uint i = 0; i < v.size(); ++i)
+            handle(v[i]);
+**/
+
+namespace ot {
+
+///Tracer launch parameters, see explosions::launch_tracer
+struct tracer_desc
+{
+    double3 pos;                        //< launch position
+    float3 speed;                       //< launch speed vector
+    float size = 1.0f;                  //< tracer size
+    float3 color = float3(1);           //< tracer color
+    float fadeout = 0.5f;               //< emission reduction for each older point on the trail
+    float trail = 0.2f;                 //< length of the trail in seconds
+    float timeout = 0.0f;               //< time [s] of tracer existence: <=0 means until hitting the ground
+    float age = 0.0f;                   //< age of the tracer
+    entity_handle entid;                //< object id to be dragged by tracer
+    uint uservalue = 0;                 //< custom value returned in impact_info::value
+};
+
+///Contiguous range of pool tracer ids
+struct tracer_range
+{
+    uint first = 0;
+    uint count = 0;
+
+    uint operator [] (uint i) const { return first + i; }
+};
+
+///View into an impact channel ring, at most two contiguous parts
+struct impact_view
+{
+    const impact_info* part[2] = { 0, 0 };
+    uint npart[2] = { 0, 0 };
+    uint64 lost = 0;                    //< impacts overwritten before the reader got to them
+
+    uint size() const { return npart[0] + npart[1]; }
+
+    const impact_info& operator [] (uint i) const {
+        return i < npart[0] ? part[0][i] : part[1][i - npart[0]];
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class tracer_pool
+{
+public:
+
+    enum {
+        ANY = UMAX32,                   //< channel filter matching any uservalue/entid
+    };
+
+    //@param exp explosions interface
+    //@param capacity max number of live tracers (rounded up to power of 2)
+    explicit tracer_pool( const iref<explosions>& exp, uint capacity = 16384 )
+        : _exp(exp)
+    {
+        uint n = 1;
+        while (n < capacity)
+            n <<= 1;
+
+        _slots.resize(n);
+        for (uint i = 0; i < n; ++i)
+            _slots[i].id = UMAX32;
+
+        _used.resize((n + 63) / 64);
+        for (uint i = 0; i < _used.size(); ++i)
+            _used[i] = 0;
+    }
+
+    ///Launch a batch of tracers
+    //@return contiguous range of pool ids, empty if the pool is out of slots
+    tracer_range launch_tracers( const coid::range<tracer_desc>& descs ) {
+        return launch_tracers(descs.ptr(), uint(descs.size()));
+    }
+
+    ///Launch a batch of tracers
+    //@param descs array of tracer descriptors
+    //@param n number of tracers
+    //@return contiguous range of pool ids, empty if there's no run of n free slots
+    tracer_range launch_tracers( const tracer_desc* descs, uint n )
+    {
+        tracer_range r;
+        if (!n || n > free_slots())
+            return r;
+
+        uint first = find_run(n);
+        if (first == UMAX32)
+            return r;
+
+        _next = first;
+        r.first = first;
+        r.count = n;
+
+        const uint mask = uint(_slots.size()) - 1;
+        const tracer_desc* d = descs;
+
+        for (uint i = 0; i < n; ++i, ++d)
+        {
+            uint id = _next++;
+            uint si = id & mask;
+            slot& s = _slots[si];
+            DASSERT(s.id == UMAX32);
+
+            _used[si >> 6] |= uint64(1) << (si & 63);
+            s.id = id;
+            s.uservalue = d->uservalue;
+            s.entid = d->entid;
+            s.expire = d->timeout > 0 ? _time + d->timeout : 0;
+            s.tid = _exp->launch_tracer(d->pos, d->speed, d->size, d->color,
+                d->fadeout, d->trail, d->timeout, d->age, UMAX32, d->entid, id);
+        }
+
+        _live += n;
+        return r;
+    }
+
+    ///Launch single tracer
+    //@return pool id, UMAX32 if the pool is out of slots
+    uint launch_tracer( const tracer_desc& desc ) {
+        tracer_range r = launch_tracers(&desc, 1);
+        return r.count ? r.first : UMAX32;
+    }
+
+    ///Destroy tracer before the end of lifetime
+    void destroy_tracer( uint id )
+    {
+        slot& s = _slots[id & (uint(_slots.size()) - 1)];
+        if (s.id != id)
+            return;
+
+        _exp->destroy_tracer(s.tid);
+        release(s);
+    }
+
+    ///Register impact channel
+    //@param uservalue uservalue to match, ANY for all
+    //@param entid entity handle to match, default (invalid) handle for all
+    //@param capacity ring size (rounded up to power of 2)
+    //@return channel id
+    uint add_channel( uint uservalue = ANY, entity_handle entid = entity_handle(), uint capacity = 4096 )
+    {
+        uint n = 1;
+        while (n < capacity)
+            n <<= 1;
+
+        channel* ch = _channels.add();
+        ch->uservalue = uservalue;
+        ch->entid = entid;
+        ch->any_entity = entid == entity_handle();
+        ch->ring.resize(n);
+        ch->write = 0;
+        return uint(_channels.size() - 1);
+    }
+
+    ///Fetch landed tracers and route them into channels, call once per frame
+    //@param dt time step since the last poll
+    //@return number of impacts fetched
+    uint poll( float dt )
+    {
+        _time += dt;
+
+        const coid::dynarray<impact_info>& landed = _exp->landed_tracers();
+        const uint mask = uint(_slots.size()) - 1;
+        uint n = uint(landed.size());
+
+        for (uint i = 0; i < n; ++i)
+        {
+            impact_info imp = landed[i];
+            entity_handle entid;
+
+            //map the host uservalue back to the pool slot
+            slot& s = _slots[imp.value & mask];
+            if (s.id == imp.value && s.tid == imp.tid) {
+                imp.value = s.uservalue;
+                entid = s.entid;
+                release(s);
+            }
+
+            route(imp, entid);
+        }
+
+        //expire timed-out tracers that never hit anything
+        for (uint w = 0, nw = uint(_used.size()); w < nw && _live; ++w) {
+            for (uint64 bits = _used[w]; bits; bits &= bits - 1) {
+                slot& s = _slots[(w << 6) + std::countr_zero(bits)];
+                if (s.expire > 0 && s.expire <= _time)
+                    release(s);
+            }
+        }
+
+        return n;
+    }
+
+    ///Get impacts added since the cursor
+    //@param chan channel id
+    //@param cursor [in/out] reader position, 0 for the first read
+    //@return view into the channel ring, valid until the next poll()
+    impact_view impacts( uint chan, uint64& cursor ) const
+    {
+        const channel& ch = _channels[chan];
+        const uint64 cap = ch.ring.size();
+
+        impact_view v;
+        if (ch.write - cursor > cap) {
+            v.lost = ch.write - cursor - cap;
+            cursor = ch.write - cap;
+        }
+
+        uint64 n = ch.write - cursor;
+        uint begin = uint(cursor & (cap - 1));
+        uint first = uint(n < cap - begin ? n : cap - begin);
+
+        v.part[0] = ch.ring.ptr() + begin;
+        v.npart[0] = first;
+        v.part[1] = ch.ring.ptr();
+        v.npart[1] = uint(n - first);
+
+        cursor = ch.write;
+        return v;
+    }
+
+    //@return number of live tracers
+    uint live() const { return _live; }
+
+    //@return number of free slots, a batch also needs them contiguous
+    uint free_slots() const {
+        return uint(_slots.size()) - _live;
+    }
+
+private:
+
+    struct slot
+    {
+        uint id;                        //< pool id, UMAX32 if free
+        uint tid;                       //< host tracer id
+        uint uservalue;                 //< client's uservalue
+        entity_handle entid;
+        double expire;                  //< expiration time, 0 if none
+    };
+
+    struct channel
+    {
+        uint uservalue;
+        entity_handle entid;
+        bool any_entity;
+        coid::dynarray<impact_info> ring;
+        uint64 write;                   //< total impacts written
+    };
+
+    void release( slot& s ) {
+        uint si = s.id & (uint(_slots.size()) - 1);
+        _used[si >> 6] &= ~(uint64(1) << (si & 63));
+        s.id = UMAX32;
+        --_live;
+    }
+
+    ///Find a run of n free slots in ring order, starting at the next id
+    //@return first pool id of the run, UMAX32 if none within one pass over the ring
+    uint find_run( uint n ) const
+    {
+        const uint size = uint(_slots.size());
+        const uint mask = size - 1;
+
+        uint id = _next;
+        uint run = 0;
+
+        for (uint scanned = 0; scanned < 2 * size; ) {
+            uint si = id & mask;
+            uint64 w = _used[si >> 6] >> (si & 63);
+
+            if (w & 1) {
+                //occupied, restart the run past it
+                ++id;
+                ++scanned;
+                run = 0;
+                continue;
+            }
+
+            //free slots up to the next occupied one, the word end or the ring end
+            uint avail = w ? uint(std::countr_zero(w)) : 64 - (si & 63);
+            if (avail > size - si)
+                avail = size - si;
+            if (avail > n - run)
+                avail = n - run;
+
+            id += avail;
+            scanned += avail;
+            run += avail;
+            if (run == n)
+                return id - n;
+        }
+
+        return UMAX32;
+    }
+
+    void route( const impact_info& imp, entity_handle entid )
+    {
+        channel* ch = _channels.ptr();
+        channel* che = _channels.ptr() + _channels.size();
+
+        for (; ch < che; ++ch) {
+            if (ch->uservalue != ANY && ch->uservalue != imp.value)
+                continue;
+            if (!ch->any_entity && !(ch->entid == entid))
+                continue;
+
+            uint64 cap = ch->ring.size();
+            ch->ring[uint(ch->write & (cap - 1))] = imp;
+            ++ch->write;
+        }
+    }
+
+private:
+
+    iref<explosions> _exp;
+
+    coid::dynarray<slot> _slots;        //< ring of tracer slots indexed by pool id
+    coid::dynarray<uint64> _used;       //< occupancy bitmap of the slots
+    uint _next = 0;                     //< next pool id to allocate
+    uint _live = 0;
+
+    coid::dynarray<channel> _channels;
+
+    double _time = 0;
+};
+
+} //namespace ot
+
+#endif //__OT_TRACER_POOL_H__
@@ -0,0 +1,225 @@
+#pragma once
+#ifndef __OT_TRANSFORM_BATCH_H__
+#define __OT_TRANSFORM_BATCH_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/dynarray.h>
+
+#include <type_traits>
+
+#include "geom_types.h"
+#include "object_handle.h"
+#include "glm/glm_ext.h"
+
+/**
+    Batched transform read/write for many objects, in SoA layout.
+
+    Traffic and crowd style plugins move thousands of objects per frame.
+    transform_batch keeps the object pointers, positions, rotations and
+    EEntityModifyFlags of a set of objects in separate arrays, so the
+    simulation can update them in tight loops, and then writes back only
+    what has changed with the cheapest call per object:
+        - position and rotation changed: set_pos_rot
+        - only position or only rotation changed: set_pos or set_rot
+        - nothing changed: no call
+
+    set() derives the flags by comparing with the last read or written
+    values, so unchanged objects cost nothing; the arrays can also be
+    written directly with the flags set by the caller.
+
+    Works with any interface with get_pos/get_rot/set_pos/set_rot/set_pos_rot
+    (geomob, object, static_object). Object pointers can be bulk-resolved
+    from an object_handle_table, without touching the refcounts.
+
+    Transforms are world (ECEF) ones, as taken by the setters. geomob
+    get_pos/get_rot are relative to the parent for child objects, so geomob
+    transforms are read with get_ecef_pos/get_ecef_rot instead.
+
+    Example:
+        ot::transform_batch<ot::geomob> tb;
+        tb.bind(table, handles.ptr(), handles.size());
+        tb.read();
+
+        for (uint i = 0; i < tb.size(); ++i)
+            tb.set(i, tb.pos()[i] + vel[i] * dt, tb.rot()[i]);
+
+        tb.write();
+**/
+
+namespace ot {
+
+////////////////////////////////////////////////////////////////////////////////
+template <class T>
+class transform_batch
+{
+public:
+
+    ///Counters of the last read/write
+    struct stats
+    {
+        uint read = 0;                  //< objects read
+        uint pos_rot = 0;               //< set_pos_rot calls
+        uint pos = 0;                   //< set_pos calls
+        uint rot = 0;                   //< set_rot calls
+        uint unchanged = 0;             //< objects skipped in write
+    };
+
+    ///Remove all objects
+    void reset() {
+        _obj.reset();
+        _pos.reset();
+        _rot.reset();
+        _flags.reset();
+    }
+
+    ///Add object
+    //@return index in the batch
+    uint add( T* obj )
+    {
+        uint i = uint(_obj.size());
+        *_obj.add() = obj;
+        *_pos.add() = double3(0);
+        *_rot.add() = quat(1, 0, 0, 0);
+        *_flags.add() = 0;
+        return i;
+    }
+
+    ///Bind the batch to objects from a handle table, invalid handles give null objects
+    //@return number of valid handles
+    uint bind( const object_handle_table<T>& table, const object_handle<T>* h, uint n )
+    {
+        resize(n);
+        return table.resolve(h, n, _obj.ptr());
+    }
+
+    ///Set number of objects, object pointers must be filled through obj()
+    void resize( uint n )
+    {
+        _obj.resize(n);
+        _pos.resize(n);
+        _rot.resize(n);
+        _flags.resize(n);
+        ::memset(_flags.ptr(), 0, n);
+    }
+
+    uint size() const { return uint(_obj.size()); }
+
+    //@{ SoA arrays
+    T** obj() { return _obj.ptr(); }
+    double3* pos() { return _pos.ptr(); }
+    quat* rot() { return _rot.ptr(); }
+    uint8* flags() { return _flags.ptr(); }         //< EEntityModifyFlags per object
+    //@}
+
+    ///Read current world transforms of all objects, clearing the modify flags
+    void read()
+    {
+        const uint n = size();
+        T* const* obj = _obj.ptr();
+        double3* pos = _pos.ptr();
+        quat* rot = _rot.ptr();
+
+        for (uint i = 0; i < n; ++i) {
+            if (!obj[i])
+                continue;
+
+            if constexpr (std::is_base_of_v<geomob, T>) {
+                pos[i] = obj[i]->get_ecef_pos();
+                rot[i] = obj[i]->get_ecef_rot();
+            }
+            else {
+                pos[i] = obj[i]->get_pos();
+                rot[i] = obj[i]->get_rot();
+            }
+        }
+
+        ::memset(_flags.ptr(), 0, n);
+        _stats.read = n;
+    }
+
+    ///Set new transform, flagging only what differs from the current values
+    void set( uint i, const double3& pos, const quat& rot )
+    {
+        uint8 f = _flags[i];
+        if (pos != _pos[i]) {
+            _pos[i] = pos;
+            f |= EntityPositionChanged;
+        }
+        if (rot != _rot[i]) {
+            _rot[i] = rot;
+            f |= EntityRotationChanged;
+        }
+        _flags[i] = f;
+    }
+
+    void set_pos( uint i, const double3& pos ) {
+        if (pos != _pos[i]) {
+            _pos[i] = pos;
+            _flags[i] |= EntityPositionChanged;
+        }
+    }
+
+    void set_rot( uint i, const quat& rot ) {
+        if (rot != _rot[i]) {
+            _rot[i] = rot;
+            _flags[i] |= EntityRotationChanged;
+        }
+    }
+
+    ///Write changed transforms back to the objects, clearing the modify flags
+    //@return number of objects updated
+    uint write()
+    {
+        _stats.pos_rot = _stats.pos = _stats.rot = _stats.unchanged = 0;
+
+        const uint n = size();
+        T* const* obj = _obj.ptr();
+        const double3* pos = _pos.ptr();
+        const quat* rot = _rot.ptr();
+        uint8* flags = _flags.ptr();
+
+        for (uint i = 0; i < n; ++i)
+        {
+            uint8 f = flags[i] & (EntityPositionChanged | EntityRotationChanged);
+            flags[i] = 0;
+
+            if (!f || !obj[i]) {
+                ++_stats.unchanged;
+                continue;
+            }
+
+            if (f == (EntityPositionChanged | EntityRotationChanged)) {
+                obj[i]->set_pos_rot(pos[i], rot[i]);
+                ++_stats.pos_rot;
+            }
+            else if (f == EntityPositionChanged) {
+                obj[i]->set_pos(pos[i]);
+                ++_stats.pos;
+            }
+            else {
+                obj[i]->set_rot(rot[i]);
+                ++_stats.rot;
+            }
+        }
+
+        return n - _stats.unchanged;
+    }
+
+    const stats& get_stats() const { return _stats; }
+
+private:
+
+    coid::dynarray<T*> _obj;
+    coid::dynarray<double3> _pos;
+    coid::dynarray<quat> _rot;
+    coid::dynarray<uint8> _flags;
+
+    stats _stats;
+};
+
+} //namespace ot
+
+#endif //__OT_TRANSFORM_BATCH_H__
@@ -0,0 +1,448 @@
+#pragma once
+#ifndef __OT_Y4M_SINK_H__
+#define __OT_Y4M_SINK_H__
+
+//See LICENSE file for copyright and license information
+
+#include <comm/commtypes.h>
+#include <comm/commassert.h>
+#include <comm/str.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#define OT_Y4M_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#define OT_Y4M_NOMINMAX
+#endif
+#include <windows.h>
+#ifdef OT_Y4M_LEAN_AND_MEAN
+#undef WIN32_LEAN_AND_MEAN
+#undef OT_Y4M_LEAN_AND_MEAN
+#endif
+#ifdef OT_Y4M_NOMINMAX
+#undef NOMINMAX
+#undef OT_Y4M_NOMINMAX
+#endif
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "i420_recorder.h"
+
+/**
+    Uncompressed Y4M capture sink for i420_recorder.
+
+    Frames are written sequentially into preallocated, memory-mapped files:
+    each chunk file is extended to its full size up front and written
+    through a sliding mapped window, so writing a frame is a plain memory
+    copy without any syscalls. On Linux the window is advised for
+    transparent huge pages. When a chunk fills up, it is truncated to the
+    written size and the capture continues in the next chunk file, each one
+    a standalone Y4M stream.
+
+    Frame indices are derived from timestamp_ns at the nominal frame rate:
+    gaps (missed frames) are filled by repeating the previous frame, frames
+    arriving faster than the frame rate are skipped, so the output keeps a
+    constant rate in sync with the render time. A gap longer than max_repeat
+    frames (a pause, a clock jump) is filled with max_repeat frames only and
+    the frame clock is rebased to the new frame, so that a single write
+    doesn't stall the recorder thread copying thousands of frames.
+
+    Example:
+        iref<ot::i420_recorder> rec = ot::video_recorder::create(
+            new ot::i420_recorder(new ot::y4m_sink(60)));
+**/
+
+namespace ot {
+
+////////////////////////////////////////////////////////////////////////////////
+///Preallocated file written through a sliding mapped window
+class mapped_file
+{
+public:
+
+    ~mapped_file() { close(0); }
+
+    bool is_open() const { return _open; }
+
+    ///Create file preallocated to given size
+    bool create( const char* path, uint64 size )
+    {
+#ifdef _WIN32
+        _file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, 0, CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+        if (_file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER li;
+        li.QuadPart = LONGLONG(size);
+        if (!SetFilePointerEx(_file, li, 0, FILE_BEGIN) || !SetEndOfFile(_file)) {
+            CloseHandle(_file);
+            return false;
+        }
+
+        _map = CreateFileMappingA(_file, 0, PAGE_READWRITE, DWORD(size >> 32), DWORD(size), 0);
+        if (!_map) {
+            CloseHandle(_file);
+            return false;
+        }
+
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        _granularity = si.dwAllocationGranularity;
+#else
+        _fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (_fd < 0)
+            return false;
+
+        if (::posix_fallocate(_fd, 0, off_t(size)) != 0 && ::ftruncate(_fd, off_t(size)) != 0) {
+            ::close(_fd);
+            return false;
+        }
+
+        _granularity = uint(sysconf(_SC_PAGESIZE));
+#endif
+        _size = size;
+        _open = true;
+        return true;
+    }
+
+    ///Get pointer for writing given range
+    //@return null if the range does not fit the file
+    uint8* map( uint64 offset, uints len, uints window )
+    {
+        if (offset + len > _size)
+            return 0;
+
+        if (!_view || offset < _voffset || offset + len > _voffset + _vsize)
+        {
+            unmap();
+
+            _voffset = offset & ~uint64(_granularity - 1);
+            _vsize = window;
+            if (_voffset + _vsize < offset + len)
+                _vsize = uints(offset + len - _voffset);
+            if (_voffset + _vsize > _size)
+                _vsize = uints(_size - _voffset);
+
+#ifdef _WIN32
+            _view = (uint8*)MapViewOfFile(_map, FILE_MAP_WRITE, DWORD(_voffset >> 32), DWORD(_voffset), _vsize);
+#else
+            void* p = ::mmap(0, _vsize, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, off_t(_voffset));
+            _view = p == MAP_FAILED ? 0 : (uint8*)p;
+#ifdef MADV_HUGEPAGE
+            if (_view)
+                ::madvise(_view, _vsize, MADV_HUGEPAGE);
+#endif
+            if (_view)
+                ::madvise(_view, _vsize, MADV_SEQUENTIAL);
+#endif
+            if (!_view)
+                return 0;
+        }
+
+        return _view + (offset - _voffset);
+    }
+
+    ///Unmap, truncate to the written size and close
+    void close( uint64 size )
+    {
+        if (!_open)
+            return;
+
+        unmap();
+#ifdef _WIN32
+        CloseHandle(_map);
+        LARGE_INTEGER li;
+        li.QuadPart = LONGLONG(size);
+        SetFilePointerEx(_file, li, 0, FILE_BEGIN);
+        SetEndOfFile(_file);
+        CloseHandle(_file);
+#else
+        if (::ftruncate(_fd, off_t(size)) != 0) {
+            //keep the preallocated tail, the stream is still valid up to size
+        }
+        ::close(_fd);
+#endif
+        _open = false;
+    }
+
+private:
+
+    void unmap()
+    {
+        if (!_view)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(_view);
+#else
+        ::munmap(_view, _vsize);
+#endif
+        _view = 0;
+    }
+
+#ifdef _WIN32
+    HANDLE _file = INVALID_HANDLE_VALUE;
+    HANDLE _map = 0;
+#else
+    int _fd = -1;
+#endif
+    uint64 _size = 0;
+    uint _granularity = 4096;
+    bool _open = false;
+
+    uint8* _view = 0;
+    uint64 _voffset = 0;
+    uints _vsize = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class y4m_sink : public i420_sink
+{
+public:
+
+    ///Capture counters
+    struct stats
+    {
+        uint64 frames = 0;              //< frames in the output, including repeats
+        uint64 repeated = 0;            //< frames repeated to fill timestamp gaps
+        uint64 skipped = 0;             //< input frames skipped as too early
+        uint64 rebased = 0;             //< gaps longer than max_repeat, the frame clock was rebased
+        uint64 bytes = 0;               //< bytes written
+        uint chunks = 0;                //< chunk files created
+    };
+
+    //@param fps nominal output frame rate
+    //@param chunk_size max size of a chunk file
+    //@param window size of the mapped window
+    //@param max_repeat max frames repeated to fill a single timestamp gap
+    explicit y4m_sink( uint fps = 60, uint64 chunk_size = uint64(16) << 30, uints window = uints(256) << 20,
+        uint max_repeat = 60 )
+        : _fps(fps ? fps : 60)
+        , _chunk_size(chunk_size)
+        , _window(window)
+        , _max_repeat(max_repeat)
+    {}
+
+    ~y4m_sink() { close(); }
+
+    const stats& get_stats() const { return _stats; }
+
+    bool open( const coid::token& video_folder, uint width, uint height ) override
+    {
+        close();
+
+        _folder = video_folder;
+        _width = width;
+        _height = height;
+        //C420 chroma planes are (W+1)/2 wide, the recorder delivers W/2
+        _cwidth = (width + 1) / 2;
+        _cheight = (height + 1) / 2;
+        _frame_bytes = 6 + uints(width) * height + 2 * uints(_cwidth) * _cheight;
+
+        if (_window < 2 * _frame_bytes)
+            _window = 2 * _frame_bytes;
+
+        _stats = stats();
+        _first_ts = UMAX64;
+        _last_index = 0;
+        _chunk = 0;
+
+        return next_chunk();
+    }
+
+    void write( const i420_frame& f ) override
+    {
+        if (!_file.is_open())
+            return;
+
+        if (_first_ts == UMAX64)
+            _first_ts = f.timestamp_ns;
+
+        //output frame index from the render time, a timestamp before the start wraps to a huge gap
+        uint64 dt = f.timestamp_ns - _first_ts;
+        uint64 index = dt < UMAX64 / _fps ? (dt * _fps + 500000000) / 1000000000 : UMAX64;
+
+        if (_stats.frames && index < _last_index + 1) {
+            ++_stats.skipped;
+            return;
+        }
+
+        //fill the gap with the previous frame, at most max_repeat frames
+        bool rebase = _stats.frames && index - _last_index - 1 > _max_repeat;
+        uint64 end = rebase ? _last_index + 1 + _max_repeat : index;
+
+        while (_stats.frames && _last_index + 1 < end) {
+            if (!repeat_frame())
+                break;
+            ++_last_index;
+            ++_stats.repeated;
+        }
+
+        if (rebase) {
+            //continue the frame clock from this frame
+            index = _last_index + 1;
+            _first_ts = f.timestamp_ns - index * 1000000000 / _fps;
+            ++_stats.rebased;
+        }
+
+        if (write_frame(f))
+            _last_index = index;
+    }
+
+    void close() override
+    {
+        if (_file.is_open()) {
+            _file.close(_pos);
+            _stats.bytes += _pos;
+        }
+    }
+
+private:
+
+    bool next_chunk()
+    {
+        if (_file.is_open()) {
+            _file.close(_pos);
+            _stats.bytes += _pos;
+        }
+
+        coid::charstr path = _folder;
+        path << "/capture_" << _width << 'x' << _height;
+        if (_chunk)
+            path << '_' << _chunk;
+        path << ".y4m";
+        ++_chunk;
+
+        char header[128];
+        int hlen = snprintf(header, sizeof(header), "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", _width, _height, _fps);
+
+        uint64 size = _chunk_size;
+        if (size < hlen + 2 * _frame_bytes)
+            size = hlen + 2 * _frame_bytes;
+
+        if (!_file.create(path.c_str(), size))
+            return false;
+
+        uint8* p = _file.map(0, hlen, _window);
+        if (!p) {
+            _file.close(0);
+            return false;
+        }
+
+        ::memcpy(p, header, hlen);
+        _pos = hlen;
+        _prev = 0;
+        ++_stats.chunks;
+        return true;
+    }
+
+    ///Reserve space for the next frame, rolling over to a new chunk if needed
+    uint8* reserve()
+    {
+        uint8* p = _file.map(_pos, _frame_bytes, _window);
+        if (!p) {
+            if (!next_chunk())
+                return 0;
+            p = _file.map(_pos, _frame_bytes, _window);
+        }
+        return p;
+    }
+
+    bool write_frame( const i420_frame& f )
+    {
+        uint8* p = reserve();
+        if (!p)
+            return false;
+
+        uint8* dst = p;
+        ::memcpy(dst, "FRAME\n", 6);
+        dst += 6;
+        dst = copy_plane(dst, f.y, f.width, f.height, f.ystride);
+        dst = copy_chroma(dst, f.u, f.cwidth, _cwidth, f.cheight, f.cstride);
+        dst = copy_chroma(dst, f.v, f.cwidth, _cwidth, f.cheight, f.cstride);
+
+        _prev = _pos;
+        _pos += _frame_bytes;
+        ++_stats.frames;
+        return true;
+    }
+
+    ///Repeat the last written frame
+    bool repeat_frame()
+    {
+        uint64 prev = _prev;
+        if (!prev)
+            return false;
+
+        //the previous frame may be outside the window after a remap, copy through a scratch buffer
+        const uint8* src = _file.map(prev, _frame_bytes, _window);
+        if (!src)
+            return false;
+
+        _scratch.resize(_frame_bytes);
+        ::memcpy(_scratch.ptr(), src, _frame_bytes);
+
+        uint8* p = reserve();
+        if (!p)
+            return false;
+
+        ::memcpy(p, _scratch.ptr(), _frame_bytes);
+        _prev = _pos;
+        _pos += _frame_bytes;
+        ++_stats.frames;
+        return true;
+    }
+
+    static uint8* copy_plane( uint8* dst, const uint8* src, uint w, uint h, uint stride )
+    {
+        for (uint r = 0; r < h; ++r, src += stride, dst += w)
+            ::memcpy(dst, src, w);
+        return dst;
+    }
+
+    ///Copy chroma plane, padding the rows to w by repeating the last sample
+    static uint8* copy_chroma( uint8* dst, const uint8* src, uint sw, uint w, uint h, uint stride )
+    {
+        if (sw >= w)
+            return copy_plane(dst, src, w, h, stride);
+
+        for (uint r = 0; r < h; ++r, src += stride, dst += w) {
+            ::memcpy(dst, src, sw);
+            ::memset(dst + sw, sw ? src[sw - 1] : 128, w - sw);
+        }
+        return dst;
+    }
+
+private:
+
+    uint _fps;
+    uint64 _chunk_size;
+    uints _window;
+    uint _max_repeat;
+
+    coid::charstr _folder;
+    uint _width = 0, _height = 0;
+    uint _cwidth = 0, _cheight = 0;
+    uints _frame_bytes = 0;
+
+    mapped_file _file;
+    uint64 _pos = 0;                    //< write position in the current chunk
+    uint64 _prev = 0;                   //< position of the last frame in the current chunk, 0 if none
+    uint _chunk = 0;
+
+    uint64 _first_ts = UMAX64;
+    uint64 _last_index = 0;
+
+    coid::dynarray<uint8> _scratch;
+    stats _stats;
+};
+
+} //namespace ot
+
+#endif //__OT_Y4M_SINK_H__